@@ -6,6 +6,7 @@
 #include "alloc/alloc.h"
 
 #include <math.h>
+#include <pthread.h>
 #include <stdarg.h>
 #include <stddef.h>
 #include <stdio.h>
@@ -17,8 +18,8 @@
 
 // Relevant information related to an allocation/reallocation event.
 typedef struct {
-  uint32_t elt_size;
-  uint32_t count;
+  size_t elt_size;
+  size_t count;
   uint32_t line;
   char *type_name;
   char *func;
@@ -31,6 +32,9 @@ static bool _is_verbose = false;
 static Set *_in_mem = NULL;
 // Avoid self-initialized memory allocation within Set.
 static volatile bool _alloc_busy = false;
+// Guards [_in_mem] and [_alloc_busy], since threads like the interner's may
+// allocate at the same time.
+static pthread_mutex_t _in_mem_lock = PTHREAD_MUTEX_INITIALIZER;
 // True if inited.
 static volatile bool _is_inited = false;
 
@@ -52,13 +56,15 @@ void alloc_init() {
   ASSERT_NULL(_in_mem);
   _in_mem =
       set_create(32781, default_hasher, default_comparator, _calloc, _free);
+  // Resizing all at once would stall whichever allocation fills the set.
+  set_use_incremental_resize(_in_mem);
   _alloc_busy = false;
   _is_inited = true;
 }
 
 bool alloc_ready() { return _is_inited; }
 
-_AllocInfo _alloc_info(uint32_t elt_size, uint32_t count, uint32_t line,
+_AllocInfo _alloc_info(size_t elt_size, size_t count, uint32_t line,
                        const char type_name[], const char func[],
                        const char file[]) {
   _AllocInfo info = {.elt_size = elt_size, .count = count, .line = line};
@@ -96,7 +102,7 @@ void alloc_finalize() {
     void *ptr = value(&iter);
     ASSERT_NOT_NULL(ptr);
     _AllocInfo *info = (_AllocInfo *)((char *)ptr - _alloc_info_size());
-    fprintf(stderr, "Forgot to free %p(%sx%d) allocated at %s:%d in %s(...)\n",
+    fprintf(stderr, "Forgot to free %p(%sx%zu) allocated at %s:%d in %s(...)\n",
             ptr, info->type_name, info->count, info->file, info->line,
             info->func);
     fflush(stderr);
@@ -108,6 +114,7 @@ void alloc_finalize() {
 }
 
 void alloc_to_csv(FILE *file) {
+  pthread_mutex_lock(&_in_mem_lock);
   volatile bool alloc_val = _alloc_busy;
   _alloc_busy = true;
   ASSERT_NOT_NULL(_in_mem);
@@ -117,16 +124,18 @@ void alloc_to_csv(FILE *file) {
     void *ptr = value(&iter);
     ASSERT_NOT_NULL(ptr);
     _AllocInfo *info = (_AllocInfo *)((char *)ptr - _alloc_info_size());
-    fprintf(file, "%s,%d,%d,%s,%d,%s,%p\n", info->type_name, info->elt_size,
+    fprintf(file, "%s,%zu,%zu,%s,%d,%s,%p\n", info->type_name, info->elt_size,
             info->count, info->file, info->line, info->func, ptr);
   }
   fflush(file);
   _alloc_busy = alloc_val;
+  pthread_mutex_unlock(&_in_mem_lock);
 }
 
-void _alloc_register(void *ptr, uint32_t elt_size, uint32_t count,
+void _alloc_register(void *ptr, size_t elt_size, size_t count,
                      uint32_t line, const char func[], const char file[],
                      const char type_name[]) {
+  pthread_mutex_lock(&_in_mem_lock);
   if (!_alloc_busy) {
     _alloc_busy = true;
     if (!set_insert(_in_mem, ptr)) {
@@ -137,18 +146,24 @@ void _alloc_register(void *ptr, uint32_t elt_size, uint32_t count,
     }
     _alloc_busy = false;
   }
+  pthread_mutex_unlock(&_in_mem_lock);
 }
 
 void _alloc_unregister(void *ptr, uint32_t line, const char func[],
                        const char file[]) {
+  pthread_mutex_lock(&_in_mem_lock);
   if (!_alloc_busy) {
     _alloc_busy = true;
-    if (!set_remove(_in_mem, ptr)) {
+    bool was_allocated = set_remove(_in_mem, ptr);
+    _alloc_busy = false;
+    pthread_mutex_unlock(&_in_mem_lock);
+    if (!was_allocated) {
       __errorf(line, func, file,
                "Attempting to free %p, but it is not allocated.\n", ptr);
     }
-    _alloc_busy = false;
+    return;
   }
+  pthread_mutex_unlock(&_in_mem_lock);
 }
 
 void alloc_set_verbose(bool verbose) { _is_verbose = verbose; }
@@ -167,8 +182,8 @@ void _log_alloc(uint32_t line, const char func[], const char file[],
 }
 
 // Allocates a new block of memory and registers it.
-void *__alloc(uint32_t elt_size, uint32_t count, uint32_t line,
-              const char func[], const char file[], const char type_name[]) {
+void *__alloc(size_t elt_size, size_t count, uint32_t line, const char func[],
+              const char file[], const char type_name[]) {
   if (0 == elt_size || 0 == count) {
     __errorf(line, func, file,
              "Either allocated array is of 0 elements or it is"
@@ -184,25 +199,25 @@ void *__alloc(uint32_t elt_size, uint32_t count, uint32_t line,
   }
   void *ptr = (char *)info_ptr + info_space;
   _alloc_register(ptr, elt_size, count, line, func, file, type_name);
-  _log_alloc(line, func, file, "Allocated a %s[%d] at %p", type_name, count,
+  _log_alloc(line, func, file, "Allocated a %s[%zu] at %p", type_name, count,
              ptr);
   return ptr;
 }
 
 // Moves memory to a new location and re-registers it.
-void *__realloc(void *ptr, uint32_t elt_size, uint32_t count, uint32_t line,
+void *__realloc(void *ptr, size_t elt_size, size_t count, uint32_t line,
                 const char func[], const char file[]) {
   if (NULL == ptr) {
     __errorf(line, func, file, "Pointer argument was null.");
   }
-  int new_size = elt_size * count;
+  size_t new_size = elt_size * count;
   if (0 == new_size) {
     __errorf(line, func, file, "Tried to realloc to an empty array.");
   }
   int info_space = _alloc_info_size();
   void *info_ptr = (char *)ptr - info_space;
   _AllocInfo old_info = *((_AllocInfo *)((char *)ptr - info_space));
-  int old_size = old_info.elt_size * old_info.count;
+  size_t old_size = old_info.elt_size * old_info.count;
   void *new_info_ptr = realloc(info_ptr, info_space + new_size);
   if (NULL == new_info_ptr) {
     __errorf(line, func, file, "Failed to reallocate memory.");
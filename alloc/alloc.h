@@ -211,9 +211,9 @@ void alloc_to_csv(FILE *);
 
 // Functions that are wrapped by the macros and should not be called directly.
 #ifdef DEBUG_MEMORY
-void *__alloc(uint32_t elt_size, uint32_t count, uint32_t line,
-              const char func[], const char file[], const char type_name[]);
-void *__realloc(void *, uint32_t elt_size, uint32_t count, uint32_t line,
+void *__alloc(size_t elt_size, size_t count, uint32_t line, const char func[],
+              const char file[], const char type_name[]);
+void *__realloc(void *, size_t elt_size, size_t count, uint32_t line,
                 const char func[], const char file[]);
 void __dealloc(void **, uint32_t line, const char func[], const char file[]);
 char *__strndup(char *, size_t len, uint32_t line, const char func[],
@@ -6,59 +6,348 @@
 #include "alloc/arena/arena.h"
 
 #include <math.h>
+#include <stdio.h>
 #include <stdlib.h>
 
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #include "alloc/alloc.h"
 #include "debug/debug.h"
 
 #define DEFAULT_ELTS_IN_CHUNK 128
 
+#define ARENA_IMAGE_MAGIC 0x414E5241 // "ARNA"
+#define ARENA_IMAGE_VERSION 1
+
 // Treates a void* as a char* to make Windows CC happy.
 #define _CHAR_POINTER(void_ptr) ((char *)(void_ptr))
 
 #define _TO_ADDRESS(desc_ptr) (_CHAR_POINTER(desc_ptr) + descriptor_sz)
 #define _TO_DESCRIPTOR(ptr) ((Descriptor *)(_CHAR_POINTER(ptr) - descriptor_sz))
 
+#define _RUN_TO_ADDRESS(run_ptr) (_CHAR_POINTER(run_ptr) + sizeof(_Run))
+#define _TO_RUN(ptr) ((_Run *)(_CHAR_POINTER(ptr) - sizeof(_Run)))
+
 uint32_t descriptor_sz;
 
 struct __Subarena {
-  _Subarena *prev;
+  _Subarena *prev, *next;
   void *block;
   size_t block_sz;
+  // True if [block] is a reserved virtual range rather than malloc'd.
+  bool mapped;
 };
 
-_Subarena *_subarena_create(_Subarena *prev, size_t sz) {
+// Header placed in front of a contiguous run of items.
+typedef struct {
+  // The block holding only this run, or NULL if the run was carved out of a
+  // shared subarena.
+  _Subarena *dedicated;
+  uint32_t count;
+} _Run;
+
+// Header written at the start of a saved arena image. The used part of the
+// reserved range follows at [data_offset], which is page-aligned so it can be
+// mapped directly.
+typedef struct {
+  uint32_t magic, version;
+  uint64_t base, reserved_sz, end_sz, used_sz, data_offset;
+  uint64_t item_sz, alloc_sz;
+  uint64_t last_freed;
+  uint32_t item_count;
+} _ArenaImage;
+
+// Arenas currently initialized, most recent first.
+static __Arena *_arenas = NULL;
+
+// Blocks are allocated under the arena's name so that they are attributed to
+// the arena by alloc_to_csv().
+_Subarena *_subarena_create(_Subarena *prev, size_t sz, const char name[]) {
+  (void)name; // Only used when DEBUG_MEMORY is defined.
   _Subarena *sa = MNEW(_Subarena);
   sa->block_sz = sz * DEFAULT_ELTS_IN_CHUNK;
-  sa->block = malloc(sa->block_sz);
+  sa->block = MNEW_ARR_SZ(name, sz, DEFAULT_ELTS_IN_CHUNK);
   sa->prev = prev;
+  sa->next = NULL;
+  sa->mapped = false;
   return sa;
 }
 
+_Subarena *_subarena_create_mapped(void *block, size_t block_sz) {
+  _Subarena *sa = MNEW(_Subarena);
+  sa->block_sz = block_sz;
+  sa->block = block;
+  sa->prev = NULL;
+  sa->next = NULL;
+  sa->mapped = true;
+  return sa;
+}
+
+_Subarena *_subarena_create_dedicated(_Subarena *prev, size_t block_sz,
+                                      const char name[]) {
+  (void)name; // Only used when DEBUG_MEMORY is defined.
+  _Subarena *sa = MNEW(_Subarena);
+  sa->block_sz = block_sz;
+  sa->block = MNEW_ARR_SZ(name, 1, block_sz);
+  sa->prev = prev;
+  sa->next = NULL;
+  sa->mapped = false;
+  if (NULL != prev) {
+    prev->next = sa;
+  }
+  return sa;
+}
+
+void _subarena_release(_Subarena *sa) {
+#ifndef _WIN32
+  if (sa->mapped) {
+    munmap(sa->block, sa->block_sz);
+  } else {
+    DEALLOC(sa->block);
+  }
+#else
+  DEALLOC(sa->block);
+#endif
+  RELEASE(sa);
+}
+
 void _subarena_delete(_Subarena *sa) {
   if (NULL != sa->prev) {
     _subarena_delete(sa->prev);
   }
-  free(sa->block);
-  RELEASE(sa);
+  _subarena_release(sa);
 }
 
-void __arena_init(__Arena *arena, size_t sz, const char name[]) {
-  ASSERT_NOT_NULL(arena);
+void _arena_register(__Arena *arena) {
+  arena->prev_arena = NULL;
+  arena->next_arena = _arenas;
+  if (NULL != _arenas) {
+    _arenas->prev_arena = arena;
+  }
+  _arenas = arena;
+}
+
+void _arena_unregister(__Arena *arena) {
+  if (NULL != arena->next_arena) {
+    arena->next_arena->prev_arena = arena->prev_arena;
+  }
+  if (NULL != arena->prev_arena) {
+    arena->prev_arena->next_arena = arena->next_arena;
+  } else {
+    _arenas = arena->next_arena;
+  }
+}
+
+void _arena_init_fields(__Arena *arena, size_t sz, const char name[]) {
   descriptor_sz = ((uint32_t)ceil(((float)sizeof(Descriptor)) / 4)) * 4;
   arena->name = name;
   arena->item_sz = sz;
   arena->alloc_sz = sz + descriptor_sz;
-  arena->last = _subarena_create(NULL, arena->alloc_sz);
-  arena->next = arena->last->block;
-  arena->end = _CHAR_POINTER(arena->last->block) + arena->last->block_sz;
   arena->last_freed = NULL;
+  arena->dedicated = NULL;
   arena->item_count = 0;
+  arena->reserved = false;
+}
+
+void __arena_init(__Arena *arena, size_t sz, const char name[]) {
+  ASSERT_NOT_NULL(arena);
+  _arena_init_fields(arena, sz, name);
+  arena->last = _subarena_create(NULL, arena->alloc_sz, name);
+  arena->next = arena->last->block;
+  arena->end = _CHAR_POINTER(arena->last->block) + arena->last->block_sz;
+  _arena_register(arena);
+}
+
+#ifndef _WIN32
+
+size_t _page_round_up(size_t sz) {
+  size_t page_sz = (size_t)sysconf(_SC_PAGESIZE);
+  return ((sz + page_sz - 1) / page_sz) * page_sz;
+}
+
+// Reserves [sz] bytes of address space at [base], or wherever the system
+// chooses if [base] is NULL. Pages are only backed by memory once touched.
+void *_reserve_range(void *base, size_t sz) {
+  void *range = mmap(base, sz, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (MAP_FAILED == range) {
+    return NULL;
+  }
+  if (NULL != base && range != base) {
+    munmap(range, sz);
+    return NULL;
+  }
+  return range;
+}
+
+void __arena_init_reserved(__Arena *arena, size_t sz, const char name[],
+                           size_t max_items, void *base) {
+  ASSERT(NOT_NULL(arena), max_items > 0);
+  _arena_init_fields(arena, sz, name);
+  size_t end_sz = max_items * arena->alloc_sz;
+  size_t reserved_sz = _page_round_up(end_sz);
+  void *range = _reserve_range(base, reserved_sz);
+  if (NULL == range) {
+    FATALF("Could not reserve %zu bytes at %p for arena '%s'.", reserved_sz,
+           base, name);
+  }
+  arena->last = _subarena_create_mapped(range, reserved_sz);
+  arena->next = range;
+  arena->end = _CHAR_POINTER(range) + end_sz;
+  arena->reserved = true;
+  _arena_register(arena);
+}
+
+bool __arena_save(__Arena *arena, const char path[]) {
+  ASSERT(NOT_NULL(arena), NOT_NULL(path));
+  if (!arena->reserved) {
+    FATALF("Arena '%s' must be created with ARENA_INIT_RESERVED to be saved.",
+           arena->name);
+  }
+  _ArenaImage image = {
+      .magic = ARENA_IMAGE_MAGIC,
+      .version = ARENA_IMAGE_VERSION,
+      .base = (uint64_t)(uintptr_t)arena->last->block,
+      .reserved_sz = arena->last->block_sz,
+      .end_sz = _CHAR_POINTER(arena->end) - _CHAR_POINTER(arena->last->block),
+      .used_sz = _CHAR_POINTER(arena->next) - _CHAR_POINTER(arena->last->block),
+      .data_offset = _page_round_up(sizeof(_ArenaImage)),
+      .item_sz = arena->item_sz,
+      .alloc_sz = arena->alloc_sz,
+      .last_freed = (uint64_t)(uintptr_t)arena->last_freed,
+      .item_count = arena->item_count};
+  FILE *file = fopen(path, "wb");
+  if (NULL == file) {
+    return false;
+  }
+  bool ok = 1 == fwrite(&image, sizeof(_ArenaImage), 1, file);
+  ok = ok && 0 == fseek(file, image.data_offset, SEEK_SET);
+  ok = ok &&
+       image.used_sz == fwrite(arena->last->block, 1, image.used_sz, file);
+  return 0 == fclose(file) && ok;
 }
 
+// Returns true if [image] describes a range of [alloc_sz] slots whose used
+// part lies within a file of [file_sz] bytes.
+bool _arena_image_ok(const _ArenaImage *image, size_t alloc_sz,
+                     uint64_t file_sz) {
+  uint64_t page_sz = (uint64_t)sysconf(_SC_PAGESIZE);
+  if (ARENA_IMAGE_MAGIC != image->magic ||
+      ARENA_IMAGE_VERSION != image->version || alloc_sz != image->alloc_sz ||
+      0 != image->base % page_sz || 0 != image->reserved_sz % page_sz ||
+      0 != image->data_offset % page_sz) {
+    return false;
+  }
+  // Mapping more than was reserved would replace whatever follows the range,
+  // and mapping past the end of the file faults on first touch.
+  if (image->used_sz > image->end_sz || image->end_sz > image->reserved_sz ||
+      0 != image->used_sz % alloc_sz || 0 != image->end_sz % alloc_sz ||
+      image->data_offset > file_sz ||
+      image->used_sz > file_sz - image->data_offset) {
+    return false;
+  }
+  return 0 == image->last_freed ||
+         (image->last_freed >= image->base &&
+          image->last_freed < image->base + image->used_sz &&
+          0 == (image->last_freed - image->base) % alloc_sz);
+}
+
+bool __arena_load_mmap(__Arena *arena, size_t sz, const char name[],
+                       const char path[]) {
+  ASSERT(NOT_NULL(arena), NOT_NULL(path));
+  // Filled in separately so that [arena] is left untouched on failure.
+  __Arena loaded;
+  _arena_init_fields(&loaded, sz, name);
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  _ArenaImage image;
+  struct stat file_stat;
+  if (sizeof(_ArenaImage) != read(fd, &image, sizeof(_ArenaImage)) ||
+      0 != fstat(fd, &file_stat) || sz != image.item_sz ||
+      !_arena_image_ok(&image, loaded.alloc_sz, file_stat.st_size)) {
+    close(fd);
+    return false;
+  }
+  void *base = (void *)(uintptr_t)image.base;
+  void *range = _reserve_range(base, image.reserved_sz);
+  if (NULL == range) {
+    close(fd);
+    return false;
+  }
+  // Pointers stored in the image are absolute, so the image must be mapped
+  // over the exact range it was saved from. MAP_PRIVATE makes it
+  // copy-on-write.
+  if (image.used_sz > 0 &&
+      MAP_FAILED == mmap(range, _page_round_up(image.used_sz),
+                         PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd,
+                         image.data_offset)) {
+    munmap(range, image.reserved_sz);
+    close(fd);
+    return false;
+  }
+  close(fd);
+  loaded.last = _subarena_create_mapped(range, image.reserved_sz);
+  loaded.next = _CHAR_POINTER(range) + image.used_sz;
+  loaded.end = _CHAR_POINTER(range) + image.end_sz;
+  loaded.last_freed = (Descriptor *)(uintptr_t)image.last_freed;
+  loaded.item_count = image.item_count;
+  loaded.reserved = true;
+  *arena = loaded;
+  _arena_register(arena);
+  return true;
+}
+
+#else
+
+void __arena_init_reserved(__Arena *arena, size_t sz, const char name[],
+                           size_t max_items, void *base) {
+  FATALF("Reserved arenas are not supported on this platform.");
+}
+
+bool __arena_save(__Arena *arena, const char path[]) { return false; }
+
+bool __arena_load_mmap(__Arena *arena, size_t sz, const char name[],
+                       const char path[]) {
+  return false;
+}
+
+#endif
+
 void __arena_finalize(__Arena *arena) {
   ASSERT_NOT_NULL(arena);
+  _arena_unregister(arena);
   _subarena_delete(arena->last);
+  if (NULL != arena->dedicated) {
+    _subarena_delete(arena->dedicated);
+  }
+}
+
+// Pushes every unused slot left in the current subarena onto the free list.
+void _arena_retire_tail(__Arena *arena) {
+  while (arena->next != arena->end) {
+    Descriptor *d = (Descriptor *)arena->next;
+    d->prev_freed = arena->last_freed;
+    arena->last_freed = d;
+    arena->next = _CHAR_POINTER(arena->next) + arena->alloc_sz;
+  }
+}
+
+void _arena_new_subarena(__Arena *arena) {
+  if (arena->reserved) {
+    FATALF("Arena '%s' ran out of reserved space.", arena->name);
+  }
+  _Subarena *new_sa =
+      _subarena_create(arena->last, arena->alloc_sz, arena->name);
+  arena->last = new_sa;
+  arena->next = arena->last->block;
+  arena->end = _CHAR_POINTER(arena->last->block) + arena->last->block_sz;
 }
 
 void *__arena_alloc(__Arena *arena) {
@@ -72,17 +361,70 @@ void *__arena_alloc(__Arena *arena) {
   }
   // Allocate a new subarena if the current one is full.
   if (arena->next == arena->end) {
-    _Subarena *new_sa = _subarena_create(arena->last, arena->alloc_sz);
-    new_sa->prev = arena->last;
-    arena->last = new_sa;
-    arena->next = arena->last->block;
-    arena->end = _CHAR_POINTER(arena->last->block) + arena->last->block_sz;
+    _arena_new_subarena(arena);
   }
   void *spot = arena->next;
   arena->next = _CHAR_POINTER(arena->next) + arena->alloc_sz;
   return _TO_ADDRESS(spot);
 }
 
+void *__arena_alloc_n(__Arena *arena, uint32_t n) {
+  ASSERT(NOT_NULL(arena), n > 0);
+  // Runs are rounded up to whole slots so the slot grid of the subarena is
+  // preserved and the run can be returned to the free list slot-by-slot.
+  size_t run_sz = sizeof(_Run) + arena->item_sz * n;
+  size_t slots = (run_sz + arena->alloc_sz - 1) / arena->alloc_sz;
+  _Run *run;
+  if (!arena->reserved && slots > DEFAULT_ELTS_IN_CHUNK / 2) {
+    // Large runs get a block of their own.
+    arena->dedicated =
+        _subarena_create_dedicated(arena->dedicated, run_sz, arena->name);
+    run = (_Run *)arena->dedicated->block;
+    run->dedicated = arena->dedicated;
+  } else {
+    size_t slots_left =
+        (_CHAR_POINTER(arena->end) - _CHAR_POINTER(arena->next)) /
+        arena->alloc_sz;
+    if (slots > slots_left) {
+      _arena_retire_tail(arena);
+      _arena_new_subarena(arena);
+    }
+    run = (_Run *)arena->next;
+    run->dedicated = NULL;
+    arena->next = _CHAR_POINTER(arena->next) + slots * arena->alloc_sz;
+  }
+  run->count = n;
+  arena->item_count += n;
+  return _RUN_TO_ADDRESS(run);
+}
+
+void __arena_dealloc_n(__Arena *arena, void *ptr) {
+  ASSERT(NOT_NULL(arena), NOT_NULL(ptr));
+  _Run *run = _TO_RUN(ptr);
+  arena->item_count -= run->count;
+  _Subarena *sa = run->dedicated;
+  if (NULL != sa) {
+    if (NULL != sa->next) {
+      sa->next->prev = sa->prev;
+    } else {
+      arena->dedicated = sa->prev;
+    }
+    if (NULL != sa->prev) {
+      sa->prev->next = sa->next;
+    }
+    _subarena_release(sa);
+    return;
+  }
+  size_t run_sz = sizeof(_Run) + arena->item_sz * run->count;
+  size_t slots = (run_sz + arena->alloc_sz - 1) / arena->alloc_sz;
+  size_t i;
+  for (i = 0; i < slots; ++i) {
+    Descriptor *d = (Descriptor *)(_CHAR_POINTER(run) + i * arena->alloc_sz);
+    d->prev_freed = arena->last_freed;
+    arena->last_freed = d;
+  }
+}
+
 void __arena_dealloc(__Arena *arena, void *ptr) {
   ASSERT(NOT_NULL(arena), NOT_NULL(ptr));
   Descriptor *d = _TO_DESCRIPTOR(ptr);
@@ -93,22 +435,86 @@ void __arena_dealloc(__Arena *arena, void *ptr) {
 
 uint32_t __arena_item_size(__Arena *arena) { return arena->item_sz; }
 
+uint32_t _subarena_list_count(_Subarena *sa) {
+  uint32_t count = 0;
+  for (; NULL != sa; sa = sa->prev) {
+    count++;
+  }
+  return count;
+}
+
+// Includes the items of each dedicated block, which holds exactly one run.
 uint32_t __arena_capacity(__Arena *arena) {
-  return __arena_subarena_count(arena) * __arena_subarena_capacity(arena);
+  uint32_t capacity = _subarena_list_count(arena->last) *
+                      __arena_subarena_capacity(arena);
+  _Subarena *sa;
+  for (sa = arena->dedicated; NULL != sa; sa = sa->prev) {
+    capacity += ((_Run *)sa->block)->count;
+  }
+  return capacity;
 }
 
 uint32_t __arena_item_count(__Arena *arena) { return arena->item_count; }
 
 uint32_t __arena_subarena_capacity(__Arena *arena) {
+  if (arena->reserved) {
+    return (_CHAR_POINTER(arena->end) - _CHAR_POINTER(arena->last->block)) /
+           arena->alloc_sz;
+  }
   return DEFAULT_ELTS_IN_CHUNK;
 }
 
+// Includes the dedicated blocks of large runs.
 uint32_t __arena_subarena_count(__Arena *arena) {
-  uint32_t subarena_count = 0;
-  _Subarena *sarena = arena->last;
-  while (NULL != sarena) {
-    subarena_count++;
-    sarena = sarena->prev;
-  }
-  return subarena_count;
-}
\ No newline at end of file
+  return _subarena_list_count(arena->last) +
+         _subarena_list_count(arena->dedicated);
+}
+
+void __arena_stats(__Arena *arena, ArenaStats *stats) {
+  ASSERT(NOT_NULL(arena), NOT_NULL(stats));
+  stats->name = arena->name;
+  stats->item_sz = arena->item_sz;
+  stats->item_count = arena->item_count;
+  stats->capacity = __arena_capacity(arena);
+  stats->subarena_count = __arena_subarena_count(arena);
+  stats->bytes_reserved = 0;
+  _Subarena *sa;
+  if (arena->reserved) {
+    // Excludes the rest of the last page, which no slot can use.
+    stats->bytes_reserved =
+        _CHAR_POINTER(arena->end) - _CHAR_POINTER(arena->last->block);
+  } else {
+    for (sa = arena->last; NULL != sa; sa = sa->prev) {
+      stats->bytes_reserved += sa->block_sz;
+    }
+  }
+  for (sa = arena->dedicated; NULL != sa; sa = sa->prev) {
+    stats->bytes_reserved += sa->block_sz;
+  }
+  stats->bytes_free = 0;
+  Descriptor *d;
+  for (d = arena->last_freed; NULL != d; d = d->prev_freed) {
+    stats->bytes_free += arena->alloc_sz;
+  }
+  // Everything but the untouched end of the current subarena has been handed
+  // out at least once.
+  size_t bytes_used = stats->bytes_reserved -
+                      (_CHAR_POINTER(arena->end) - _CHAR_POINTER(arena->next));
+  stats->fragmentation =
+      (0 == bytes_used) ? 0.0 : ((double)stats->bytes_free) / bytes_used;
+}
+
+void arena_report(FILE *file) {
+  ASSERT_NOT_NULL(file);
+  fprintf(file, "name,item_size,item_count,capacity,subarena_count,"
+                "bytes_reserved,bytes_free,fragmentation\n");
+  __Arena *arena;
+  for (arena = _arenas; NULL != arena; arena = arena->next_arena) {
+    ArenaStats stats;
+    __arena_stats(arena, &stats);
+    fprintf(file, "%s,%zu,%u,%u,%u,%zu,%zu,%.4f\n", stats.name, stats.item_sz,
+            stats.item_count, stats.capacity, stats.subarena_count,
+            stats.bytes_reserved, stats.bytes_free, stats.fragmentation);
+  }
+  fflush(file);
+}
@@ -24,6 +24,7 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <stdio.h>
 
 // Declares an arena for the given type.
 //
@@ -55,6 +56,55 @@
 #define ARENA_INIT(typename)                                                   \
   __arena_init(&__ARENA__##typename, sizeof(typename), #typename)
 
+// Initializes an arena which allocates from a single reserved range of
+// virtual memory with room for [max_items] blocks.
+//
+// Details:
+//   - Pages in the range are only backed by memory once they are used.
+//   - [base] is the fixed address to reserve the range at, or NULL to let the
+//     system choose one. Images saved with ARENA_SAVE() can only be loaded
+//     back at the same address, so pass a fixed [base] if the image should be
+//     loaded by another process.
+//   - The arena cannot grow beyond [max_items].
+//
+// Usage:
+//   ARENA_INIT_RESERVED(MyType, 1000000, (void *)0x200000000000);
+#define ARENA_INIT_RESERVED(typename, max_items, base)                         \
+  __arena_init_reserved(&__ARENA__##typename, sizeof(typename), #typename,     \
+                        (max_items), (base))
+
+// Writes the contents of a reserved arena to the file at [path], returning
+// true on success.
+//
+// Details:
+//   - Can only be used on arenas initialized with ARENA_INIT_RESERVED().
+//   - Pointers between blocks in the same arena remain valid when the image is
+//     loaded. Pointers to any other memory do not.
+//
+// Usage:
+//   ARENA_SAVE(MyType, "/tmp/my_type.arena");
+#define ARENA_SAVE(typename, path) __arena_save(&__ARENA__##typename, (path))
+
+// Initializes an arena by mapping an image written by ARENA_SAVE() at [path],
+// returning true on success.
+//
+// Details:
+//   - The image is mapped copy-on-write at the address it was saved from and
+//     is not read into memory up-front.
+//   - Returns false if the file is missing, truncated, or corrupt, was saved
+//     for a type of a different size, or the address range is no longer
+//     available. The arena is left untouched in that case, so it can still be
+//     initialized some other way.
+//   - New allocations continue in the remaining reserved space.
+//
+// Usage:
+//   if (!ARENA_LOAD_MMAP(MyType, "/tmp/my_type.arena")) {
+//     ARENA_INIT_RESERVED(MyType, 1000000, (void *)0x200000000000);
+//     ...
+//   }
+#define ARENA_LOAD_MMAP(typename, path)                                        \
+  __arena_load_mmap(&__ARENA__##typename, sizeof(typename), #typename, (path))
+
 // Finalizes and does any tyding up related to an arena, freeing all memory at
 // once.
 //
@@ -84,6 +134,30 @@
 //  ARENA_DEALLOC(MyType, t);
 #define ARENA_DEALLOC(typename, ptr) __arena_dealloc(&__ARENA__##typename, ptr)
 
+// Allocates [n] contiguous blocks in the arena and returns a pointer to the
+// first one.
+//
+// Details:
+//   - The blocks are laid out like an array, so they can be indexed and
+//     copied like one.
+//   - Small runs are taken from the current subarena. Large runs are given a
+//     dedicated block of memory.
+//   - Memory is not cleared.
+//
+// Usage:
+//   MyType *arr = ARENA_ALLOC_N(MyType, 20);
+//   arr[19] = ...;
+#define ARENA_ALLOC_N(typename, n)                                             \
+  (typename *)__arena_alloc_n(&__ARENA__##typename, (n))
+
+// Deallocates all blocks allocated by a single call to ARENA_ALLOC_N().
+//
+// Usage:
+//  MyType *arr = ARENA_ALLOC_N(MyType, 20);
+//  ARENA_DEALLOC_N(MyType, arr);
+#define ARENA_DEALLOC_N(typename, ptr)                                         \
+  __arena_dealloc_n(&__ARENA__##typename, ptr)
+
 typedef struct __Subarena _Subarena;
 
 typedef struct _Descriptor Descriptor;
@@ -92,26 +166,65 @@ struct _Descriptor {
   Descriptor *prev_freed;
 };
 
-typedef struct {
+typedef struct ___Arena __Arena;
+
+struct ___Arena {
   const char *name;
   _Subarena *last;
   size_t item_sz;
   size_t alloc_sz;
   void *next, *end;
   Descriptor *last_freed;
+  _Subarena *dedicated;
   uint32_t item_count;
-} __Arena;
+  bool reserved;
+  // Links in the list of all initialized arenas.
+  __Arena *prev_arena, *next_arena;
+};
+
+// A snapshot of how an arena is using its memory.
+typedef struct {
+  const char *name;
+  size_t item_sz;
+  // Number of items currently allocated.
+  uint32_t item_count;
+  // Number of items that fit without allocating another block.
+  uint32_t capacity;
+  // Number of blocks, including those dedicated to large runs.
+  uint32_t subarena_count;
+  // Bytes held by the arena, including blocks for large runs.
+  size_t bytes_reserved;
+  // Bytes in freed slots waiting to be reused.
+  size_t bytes_free;
+  // Fraction of the bytes handed out so far that are now free.
+  double fragmentation;
+} ArenaStats;
+
+// Prints the stats of every initialized arena in CSV format.
+//
+// Details:
+//   - When DEBUG_MEMORY is defined, the blocks of each arena also appear in
+//     alloc_to_csv() under the arena's name.
+void arena_report(FILE *file);
 
 // Do not call these function directly.
 void __arena_init(__Arena *arena, size_t sz, const char name[]);
+void __arena_init_reserved(__Arena *arena, size_t sz, const char name[],
+                           size_t max_items, void *base);
+bool __arena_save(__Arena *arena, const char path[]);
+bool __arena_load_mmap(__Arena *arena, size_t sz, const char name[],
+                       const char path[]);
 void __arena_finalize(__Arena *arena);
 void *__arena_alloc(__Arena *arena);
 void __arena_dealloc(__Arena *arena, void *ptr);
+void *__arena_alloc_n(__Arena *arena, uint32_t n);
+void __arena_dealloc_n(__Arena *arena, void *ptr);
 
 uint32_t __arena_item_size(__Arena *arena);
 uint32_t __arena_capacity(__Arena *arena);
 uint32_t __arena_item_count(__Arena *arena);
 uint32_t __arena_subarena_capacity(__Arena *arena);
 uint32_t __arena_subarena_count(__Arena *arena);
+void __arena_stats(__Arena *arena, ArenaStats *stats);
 
 #endif /* ALLOC_ARENA_ARENA_H_ */
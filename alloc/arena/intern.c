@@ -5,94 +5,1183 @@
 
 #include "alloc/arena/intern.h"
 
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <string.h>
 
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
 #include "alloc/alloc.h"
 #include "debug/debug.h"
-#include "struct/set.h"
 #include "util/util.h"
 
 #define DEFAULT_CHUNK_SIZE 32488
-#define DEFAULT_HASHTABLE_SIZE 4091
+// String hashes are spread by hash_uint32(). The high bits of the result pick
+// the shard and the low bits pick the slot.
+#define SHARD_BITS 4
+#define NUM_SHARDS (1 << SHARD_BITS)
+// First chunk of each shard when the expected size is unknown. Shards share
+// the default so that a pool with a few strings stays as small as one chunk.
+#define DEFAULT_SHARD_CHUNK_SIZE (DEFAULT_CHUNK_SIZE / NUM_SHARDS)
+// Must be powers of 2.
+#define DEFAULT_SHARD_TABLE_SZ 256
+#define MIN_SHARD_TABLE_SZ 8
+#define MIN_CHUNK_SIZE 256
+// Each new chunk in a shard is twice the size of the last, up to this.
+#define MAX_CHUNK_SIZE (1 << 20)
+// Strings taking more than this fraction of a chunk get a chunk of their own.
+#define LARGE_STRING_DIVISOR 8
+// Ids are mapped to strings by segments of doubling size, the first of which
+// has 1 << ID_SEGMENT_BITS slots. Slot i of all segments together holds id
+// i - (1 << ID_SEGMENT_BITS), so 32 - ID_SEGMENT_BITS segments cover every id
+// up to MAX_ID.
+#define ID_SEGMENT_BITS 8
+#define NUM_ID_SEGMENTS (32 - ID_SEGMENT_BITS)
+#define MAX_ID (UINT32_MAX - (1 << ID_SEGMENT_BITS))
+// Number of tokens intern_bulk() hashes and prefetches before resolving them.
+#define BULK_BATCH_SZ 16
+// Blocks in refcounted pools are rounded up to a size class so that a freed
+// block can be reused by any string in its class. Classes are multiples of
+// SIZE_CLASS_GRANULARITY up to NUM_LINEAR_SIZE_CLASSES of them, then powers
+// of 2 up to 1 MiB.
+#define SIZE_CLASS_GRANULARITY 16
+#define NUM_LINEAR_SIZE_CLASSES 32
+#define NUM_SIZE_CLASSES (NUM_LINEAR_SIZE_CLASSES + 11)
+
+#define INTERN_IMAGE_MAGIC 0x4E544E49 // "INTN"
+#define INTERN_IMAGE_VERSION 2
+// Image tables are grown up to this many times past their minimum size looking
+// for one in which no two strings share a slot.
+#define MAX_IMAGE_TABLE_GROWTH 8
+
+#if defined(__GNUC__) || defined(__clang__)
+#define _PREFETCH(ptr) __builtin_prefetch(ptr)
+#define _COUNT_TRAILING_ZEROS(x) __builtin_ctz(x)
+#else
+#define _PREFETCH(ptr)
+#endif
 
 typedef struct __Chunk _Chunk;
 
+// A published interned string.
+typedef _Atomic(char *) _Slot;
+
 struct __Chunk {
   char *block;
   _Chunk *next;
+  // Only kept for large chunks, so that one can be unlinked when its string
+  // is freed.
+  _Chunk *prev;
   size_t sz;
 };
 
+// An insert-only open-addressing table of interned strings.
+//
+// Readers may still be probing a table after it has been replaced by a larger
+// one, so replaced tables are kept until the pool is deleted.
+typedef struct __Table _Table;
+
+struct __Table {
+  // The table this one replaced.
+  _Table *retired;
+  uint32_t sz;
+  _Slot slots[];
+};
+
+// Strings are partitioned across shards by hash. Each shard has its own lock
+// for insertion and its own chunks to copy new strings into. Lookups do not
+// lock.
 typedef struct {
+  pthread_mutex_t lock;
+  _Atomic(_Table *) table;
+  uint32_t count;
   char *tail, *end;
+  // Created when the first string is copied into the shard.
   _Chunk *chunk, *last;
-  Set strings;
-} _Strings;
+  // Chunks which each hold a single large string.
+  _Chunk *large;
+  // Blocks freed by intern_pool_collect() by size class, each linked to the
+  // next through its first bytes. Only used by refcounted pools.
+  char *free_blocks[NUM_SIZE_CLASSES];
+  // See InternStats.
+  size_t string_bytes, chunk_bytes, wasted_bytes, free_bytes;
+  uint32_t chunk_count, large_count;
+} _Shard;
+
+// A read-only table of interned strings mapped from a file written by
+// intern_save() or compiled in from an InternTable.
+//
+// The image is addressed entirely by offsets so that it can live anywhere. It
+// holds a header, the strings each preceded by its _Header, a hash index of
+// offsets to strings (0 marks an empty slot) probed like _Table, and the offset
+// of each string by id.
+//
+// No lookup probes more than max_probes slots of the index. When it is 1, every
+// string has a slot to itself and a lookup is a single comparison.
+typedef struct {
+  uint32_t magic, version;
+  uint32_t count, table_sz;
+  uint32_t max_probes, reserved;
+  uint64_t data_offset, data_sz, table_offset, ids_offset, file_sz;
+} _ImageHeader;
 
-static _Strings strings;
+typedef struct {
+  // The mapping to unmap when the pool is deleted, or NULL if the image is not
+  // owned by the pool.
+  void *map;
+  size_t map_sz;
+  const char *data;
+  const uint32_t *table, *ids;
+  uint32_t table_sz, count, max_probes;
+} _Image;
+
+struct __InternPool {
+  _Shard shards[NUM_SHARDS];
+  // Strings loaded by intern_load_mmap(), which are checked before the shards.
+  // New strings are always added to the shards.
+  _Image *image;
+  size_t chunk_sz;
+  // Number of ids handed out.
+  _Atomic uint32_t count;
+  // Allocated when the first id that falls in them is handed out.
+  _Atomic(_Slot *) id_segments[NUM_ID_SEGMENTS];
+  // See intern_pool_create_refcounted().
+  bool refcounted;
+  // Ids of collected strings, which are handed out again before new ones.
+  pthread_mutex_t id_lock;
+  uint32_t *free_ids;
+  uint32_t free_id_count, free_id_capacity;
+};
+
+// Backs intern(), intern_n(), and intern_range().
+static InternPool default_pool;
 
-_Chunk *_chunk_create() {
+// Stored directly before each interned string.
+typedef struct {
+  uint32_t hash;
+  uint32_t len;
+  uint32_t id;
+} _Header;
+
+// Stored directly before the _Header of each string in a refcounted pool.
+typedef struct {
+  _Atomic uint32_t refs;
+  // Size of the block holding the entry, or 0 if it has a chunk to itself.
+  uint32_t block_sz;
+} _Refs;
+
+#define _TO_HEADER(str) ((_Header *)((char *)(str) - sizeof(_Header)))
+#define _TO_REFS(str) ((_Refs *)((char *)_TO_HEADER(str) - sizeof(_Refs)))
+// In a refcounted pool, a large string's chunk begins with a pointer back to
+// the chunk, followed by its _Refs.
+#define _TO_LARGE_CHUNK(refs) (*(_Chunk **)((char *)(refs) - sizeof(_Chunk *)))
+#define _ALIGN_UP(ptr)                                                         \
+  ((char *)((((uintptr_t)(ptr)) + _Alignof(_Header) - 1) &                     \
+            ~(uintptr_t)(_Alignof(_Header) - 1)))
+#define _ALIGN_UP_SZ(sz, align) ((((sz) + (align)-1) / (align)) * (align))
+
+_Chunk *_chunk_create(size_t sz) {
   _Chunk *chunk = ALLOC2(_Chunk);
-  chunk->sz = DEFAULT_CHUNK_SIZE;
+  chunk->sz = sz;
   chunk->block = ALLOC_ARRAY2(char, chunk->sz);
-  chunk->next = NULL;
+  chunk->next = chunk->prev = NULL;
   return chunk;
 }
 
+// Deletes [chunk] and every chunk after it.
 void _chunk_delete(_Chunk *chunk) {
-  ASSERT_NOT_NULL(chunk);
-  if (NULL != chunk->next) {
-    _chunk_delete(chunk->next);
+  while (NULL != chunk) {
+    _Chunk *next = chunk->next;
+    DEALLOC(chunk->block);
+    DEALLOC(chunk);
+    chunk = next;
+  }
+}
+
+_Table *_table_create(uint32_t sz, _Table *retired) {
+  // Cleared, so every slot starts as NULL.
+  _Table *table = (_Table *)ALLOC_ARRAY(
+      char, sizeof(_Table) + sz * sizeof(_Slot));
+  table->retired = retired;
+  table->sz = sz;
+  return table;
+}
+
+void _table_delete(_Table *table) {
+  ASSERT_NOT_NULL(table);
+  if (NULL != table->retired) {
+    _table_delete(table->retired);
+  }
+  DEALLOC(table);
+}
+
+char *_table_lookup(_Table *table, const char str[], size_t len,
+                    uint32_t hval, uint32_t mixed) {
+  uint32_t mask = table->sz - 1;
+  uint32_t i = mixed & mask;
+  while (true) {
+    char *interned =
+        atomic_load_explicit(&table->slots[i], memory_order_acquire);
+    if (NULL == interned) {
+      return NULL;
+    }
+    _Header *header = _TO_HEADER(interned);
+    if (hval == header->hash && len == header->len &&
+        0 == memcmp(str, interned, len)) {
+      return interned;
+    }
+    i = (i + 1) & mask;
+  }
+}
+
+char *_image_lookup(const _Image *image, const char str[], size_t len,
+                    uint32_t hval, uint32_t mixed) {
+  uint32_t mask = image->table_sz - 1;
+  uint32_t i = mixed & mask;
+  uint32_t probes;
+  for (probes = 0; probes < image->max_probes; ++probes) {
+    uint32_t offset = image->table[i];
+    if (0 == offset) {
+      return NULL;
+    }
+    const char *interned = image->data + offset;
+    _Header *header = _TO_HEADER(interned);
+    if (hval == header->hash && len == header->len &&
+        0 == memcmp(str, interned, len)) {
+      return (char *)interned;
+    }
+    i = (i + 1) & mask;
+  }
+  return NULL;
+}
+
+// Must hold the shard lock.
+void _table_put(_Table *table, char *interned, uint32_t mixed) {
+  uint32_t mask = table->sz - 1;
+  uint32_t i = mixed & mask;
+  while (NULL !=
+         atomic_load_explicit(&table->slots[i], memory_order_relaxed)) {
+    i = (i + 1) & mask;
+  }
+  // Release so readers which see the pointer also see the string.
+  atomic_store_explicit(&table->slots[i], interned, memory_order_release);
+}
+
+// Must hold the shard lock.
+_Table *_shard_grow(_Shard *shard) {
+  _Table *old = atomic_load_explicit(&shard->table, memory_order_relaxed);
+  _Table *table = _table_create(old->sz * 2, old);
+  uint32_t i;
+  for (i = 0; i < old->sz; ++i) {
+    char *interned = atomic_load_explicit(&old->slots[i], memory_order_relaxed);
+    if (NULL != interned) {
+      _table_put(table, interned, hash_uint32(_TO_HEADER(interned)->hash));
+    }
+  }
+  atomic_store_explicit(&shard->table, table, memory_order_release);
+  return table;
+}
+
+// Must hold the shard lock.
+void _shard_add_chunk(_Shard *shard, size_t sz) {
+  _Chunk *chunk = _chunk_create(sz);
+  if (NULL == shard->chunk) {
+    shard->chunk = chunk;
+  } else {
+    shard->wasted_bytes += shard->end - shard->tail;
+    shard->last->next = chunk;
+  }
+  shard->last = chunk;
+  shard->tail = chunk->block;
+  shard->end = shard->tail + chunk->sz;
+  shard->chunk_bytes += sz;
+  shard->chunk_count++;
+}
+
+// Chunks double in size as the shard fills so that the number of chunks grows
+// logarithmically with the number of strings.
+size_t _next_chunk_sz(_Shard *shard, size_t chunk_sz) {
+  if (NULL == shard->last) {
+    return chunk_sz;
+  }
+  size_t max_sz = MAX_CHUNK_SIZE > chunk_sz ? MAX_CHUNK_SIZE : chunk_sz;
+  size_t sz = 2 * shard->last->sz;
+  return sz > max_sz ? max_sz : sz;
+}
+
+int _size_class(size_t sz) {
+  if (sz <= NUM_LINEAR_SIZE_CLASSES * SIZE_CLASS_GRANULARITY) {
+    return (sz + SIZE_CLASS_GRANULARITY - 1) / SIZE_CLASS_GRANULARITY - 1;
+  }
+  int size_class = NUM_LINEAR_SIZE_CLASSES;
+  size_t class_sz = 2 * NUM_LINEAR_SIZE_CLASSES * SIZE_CLASS_GRANULARITY;
+  while (class_sz < sz) {
+    class_sz *= 2;
+    size_class++;
+  }
+  return size_class;
+}
+
+size_t _class_sz(int size_class) {
+  if (size_class < NUM_LINEAR_SIZE_CLASSES) {
+    return (size_class + 1) * SIZE_CLASS_GRANULARITY;
   }
-  DEALLOC(chunk->block);
-  DEALLOC(chunk);
+  return ((size_t)NUM_LINEAR_SIZE_CLASSES * SIZE_CLASS_GRANULARITY)
+         << (size_class - NUM_LINEAR_SIZE_CLASSES + 1);
 }
 
-void *_malloc_fn(size_t type_sz, size_t count, const char name[]) {
-  return malloc(count * type_sz);
+// Must hold the shard lock.
+char *_shard_copy(_Shard *shard, size_t chunk_sz, bool refcounted,
+                  const char str[], size_t len, uint32_t hval) {
+  size_t prefix_sz = refcounted ? sizeof(_Refs) : 0;
+  size_t used_sz = prefix_sz + sizeof(_Header) + len + 1;
+  size_t entry_sz = used_sz;
+  size_t current_chunk_sz = (NULL == shard->last) ? chunk_sz : shard->last->sz;
+  uint32_t block_sz = 0;
+  char *entry = NULL;
+  if (entry_sz > current_chunk_sz / LARGE_STRING_DIVISOR ||
+      (refcounted && entry_sz > _class_sz(NUM_SIZE_CLASSES - 1))) {
+    // Large strings would overrun a chunk or waste the end of the current one.
+    size_t link_sz = refcounted ? sizeof(_Chunk *) : 0;
+    _Chunk *chunk = _chunk_create(link_sz + entry_sz);
+    chunk->next = shard->large;
+    if (NULL != shard->large) {
+      shard->large->prev = chunk;
+    }
+    shard->large = chunk;
+    shard->chunk_bytes += chunk->sz;
+    shard->wasted_bytes += link_sz;
+    shard->large_count++;
+    entry = chunk->block + link_sz;
+    if (refcounted) {
+      _TO_LARGE_CHUNK(entry) = chunk;
+    }
+  } else {
+    if (refcounted) {
+      int size_class = _size_class(entry_sz);
+      entry_sz = block_sz = _class_sz(size_class);
+      shard->wasted_bytes += entry_sz - used_sz;
+      entry = shard->free_blocks[size_class];
+      if (NULL != entry) {
+        memcpy(&shard->free_blocks[size_class], entry, sizeof(char *));
+        shard->free_bytes -= entry_sz;
+      }
+    }
+    if (NULL == entry) {
+      entry = _ALIGN_UP(shard->tail);
+      if (NULL == shard->chunk || entry + entry_sz > shard->end) {
+        _shard_add_chunk(shard, _next_chunk_sz(shard, chunk_sz));
+        entry = _ALIGN_UP(shard->tail);
+      }
+      shard->wasted_bytes += entry - shard->tail;
+      shard->tail = entry + entry_sz;
+    }
+  }
+  shard->string_bytes += len + 1;
+  if (refcounted) {
+    _Refs *refs = (_Refs *)entry;
+    atomic_init(&refs->refs, 1);
+    refs->block_sz = block_sz;
+    entry += sizeof(_Refs);
+  }
+  _Header *header = (_Header *)entry;
+  header->hash = hval;
+  header->len = len;
+  char *interned = entry + sizeof(_Header);
+  memmove(interned, str, len);
+  interned[len] = '\0';
+  return interned;
+}
+
+// Finds the segment and slot within it that [id] maps to.
+void _id_position(uint32_t id, int *segment, uint32_t *slot) {
+  uint64_t index = (uint64_t)id + (1 << ID_SEGMENT_BITS);
+#if defined(__GNUC__) || defined(__clang__)
+  int msb = 63 - __builtin_clzll(index);
+#else
+  int msb = 0;
+  while (index >> (msb + 1)) {
+    msb++;
+  }
+#endif
+  *segment = msb - ID_SEGMENT_BITS;
+  *slot = (uint32_t)(index - (((uint64_t)1) << msb));
+}
+
+// Assigns the next id to [interned] and makes it visible to intern_str().
+//
+// Shards insert concurrently, so segments are installed with a CAS.
+void _pool_assign_id(InternPool *pool, char *interned) {
+  uint32_t id = UINT32_MAX;
+  if (pool->refcounted) {
+    pthread_mutex_lock(&pool->id_lock);
+    if (pool->free_id_count > 0) {
+      id = pool->free_ids[--pool->free_id_count];
+    }
+    pthread_mutex_unlock(&pool->id_lock);
+  }
+  if (UINT32_MAX == id) {
+    id = atomic_fetch_add(&pool->count, 1);
+    if (id > MAX_ID) {
+      FATALF("Interned more than %u strings.", MAX_ID + 1);
+    }
+  }
+  int segment;
+  uint32_t slot;
+  _id_position(id, &segment, &slot);
+  _Slot *ids =
+      atomic_load_explicit(&pool->id_segments[segment], memory_order_acquire);
+  if (NULL == ids) {
+    _Slot *new_ids =
+        ALLOC_ARRAY(_Slot, ((size_t)1) << (segment + ID_SEGMENT_BITS));
+    if (atomic_compare_exchange_strong(&pool->id_segments[segment], &ids,
+                                       new_ids)) {
+      ids = new_ids;
+    } else {
+      DEALLOC(new_ids);
+    }
+  }
+  _TO_HEADER(interned)->id = id;
+  atomic_store_explicit(&ids[slot], interned, memory_order_release);
+}
+
+void _pool_free_id(InternPool *pool, uint32_t id) {
+  int segment;
+  uint32_t slot;
+  _id_position(id, &segment, &slot);
+  _Slot *ids =
+      atomic_load_explicit(&pool->id_segments[segment], memory_order_acquire);
+  atomic_store_explicit(&ids[slot], NULL, memory_order_release);
+  pthread_mutex_lock(&pool->id_lock);
+  if (NULL == pool->free_ids) {
+    pool->free_id_capacity = 64;
+    pool->free_ids = ALLOC_ARRAY2(uint32_t, pool->free_id_capacity);
+  } else if (pool->free_id_count == pool->free_id_capacity) {
+    pool->free_id_capacity *= 2;
+    pool->free_ids = (uint32_t *)REALLOC_SZ(pool->free_ids, sizeof(uint32_t),
+                                            pool->free_id_capacity);
+  }
+  pool->free_ids[pool->free_id_count++] = id;
+  pthread_mutex_unlock(&pool->id_lock);
+}
+
+// Frees a string whose references have all been released.
+//
+// Must hold the shard lock.
+void _shard_free_entry(InternPool *pool, _Shard *shard, char *interned) {
+  _Header *header = _TO_HEADER(interned);
+  _Refs *refs = _TO_REFS(interned);
+  _pool_free_id(pool, header->id);
+  shard->count--;
+  shard->string_bytes -= header->len + 1;
+  if (0 == refs->block_sz) {
+    _Chunk *large = _TO_LARGE_CHUNK(refs);
+    if (NULL == large->prev) {
+      shard->large = large->next;
+    } else {
+      large->prev->next = large->next;
+    }
+    if (NULL != large->next) {
+      large->next->prev = large->prev;
+    }
+    shard->chunk_bytes -= large->sz;
+    shard->wasted_bytes -= sizeof(_Chunk *);
+    shard->large_count--;
+    DEALLOC(large->block);
+    DEALLOC(large);
+    return;
+  }
+  shard->wasted_bytes -=
+      refs->block_sz - (sizeof(_Refs) + sizeof(_Header) + header->len + 1);
+  shard->free_bytes += refs->block_sz;
+  int size_class = _size_class(refs->block_sz);
+  char *block = (char *)refs;
+  memcpy(block, &shard->free_blocks[size_class], sizeof(char *));
+  shard->free_blocks[size_class] = block;
+}
+
+uint32_t _next_power_of_2(size_t n) {
+  uint32_t power = 1;
+  while (power < n) {
+    power <<= 1;
+  }
+  return power;
+}
+
+// Frees the strings in [shard] whose references have all been released and
+// rebuilds its table around the rest, returning the number freed.
+//
+// Must hold the shard lock.
+uint32_t _shard_collect(InternPool *pool, _Shard *shard) {
+  _Table *old = atomic_load_explicit(&shard->table, memory_order_relaxed);
+  // References are only added under the lock, so strings can only die between
+  // these two passes, never come back.
+  uint32_t live = 0;
+  uint32_t i;
+  for (i = 0; i < old->sz; ++i) {
+    char *interned = atomic_load_explicit(&old->slots[i], memory_order_relaxed);
+    if (NULL != interned && 0 != atomic_load(&_TO_REFS(interned)->refs)) {
+      live++;
+    }
+  }
+  uint32_t table_sz = _next_power_of_2(live * 2 + 1);
+  _Table *table = _table_create(
+      table_sz < MIN_SHARD_TABLE_SZ ? MIN_SHARD_TABLE_SZ : table_sz, NULL);
+  uint32_t collected = 0;
+  for (i = 0; i < old->sz; ++i) {
+    char *interned = atomic_load_explicit(&old->slots[i], memory_order_relaxed);
+    if (NULL == interned) {
+      continue;
+    }
+    if (0 == atomic_load(&_TO_REFS(interned)->refs)) {
+      _shard_free_entry(pool, shard, interned);
+      collected++;
+    } else {
+      _table_put(table, interned, hash_uint32(_TO_HEADER(interned)->hash));
+    }
+  }
+  atomic_store_explicit(&shard->table, table, memory_order_release);
+  // Lookups in refcounted pools hold the lock, so nothing is still reading the
+  // old tables.
+  _table_delete(old);
+  return collected;
 }
 
-void _free_fn(void **ptr) { free(*ptr); }
+void _intern_pool_init(InternPool *pool, size_t table_sz, size_t chunk_sz,
+                       bool refcounted) {
+  pool->chunk_sz = chunk_sz;
+  pool->image = NULL;
+  pool->refcounted = refcounted;
+  if (0 != pthread_mutex_init(&pool->id_lock, NULL)) {
+    FATALF("Could not initialize intern lock.");
+  }
+  pool->free_ids = NULL;
+  pool->free_id_count = pool->free_id_capacity = 0;
+  int i;
+  for (i = 0; i < NUM_SHARDS; ++i) {
+    _Shard *shard = pool->shards + i;
+    if (0 != pthread_mutex_init(&shard->lock, NULL)) {
+      FATALF("Could not initialize intern lock.");
+    }
+    atomic_init(&shard->table, _table_create(table_sz, NULL));
+    shard->count = 0;
+    shard->chunk = shard->last = shard->large = NULL;
+    shard->tail = shard->end = NULL;
+    memset(shard->free_blocks, 0, sizeof(shard->free_blocks));
+    shard->string_bytes = shard->chunk_bytes = shard->wasted_bytes = 0;
+    shard->free_bytes = 0;
+    shard->chunk_count = shard->large_count = 0;
+  }
+  atomic_init(&pool->count, 0);
+  for (i = 0; i < NUM_ID_SEGMENTS; ++i) {
+    atomic_init(&pool->id_segments[i], NULL);
+  }
+}
+
+void _intern_pool_finalize(InternPool *pool) {
+  int i;
+  for (i = 0; i < NUM_SHARDS; ++i) {
+    _Shard *shard = pool->shards + i;
+    _table_delete(atomic_load(&shard->table));
+    _chunk_delete(shard->chunk);
+    _chunk_delete(shard->large);
+    pthread_mutex_destroy(&shard->lock);
+  }
+  for (i = 0; i < NUM_ID_SEGMENTS; ++i) {
+    _Slot *ids = atomic_load(&pool->id_segments[i]);
+    if (NULL != ids) {
+      DEALLOC(ids);
+    }
+  }
+  pthread_mutex_destroy(&pool->id_lock);
+  if (NULL != pool->free_ids) {
+    DEALLOC(pool->free_ids);
+  }
+  if (NULL != pool->image) {
+#ifndef _WIN32
+    if (NULL != pool->image->map) {
+      munmap(pool->image->map, pool->image->map_sz);
+    }
+#endif
+    DEALLOC(pool->image);
+  }
+}
+
+InternPool *_pool_create(size_t expected_strings, size_t expected_bytes,
+                         bool refcounted) {
+  InternPool *pool = ALLOC2(InternPool);
+  // Tables are kept at most half full.
+  size_t table_sz = _next_power_of_2(expected_strings * 2 / NUM_SHARDS + 1);
+  if (table_sz < MIN_SHARD_TABLE_SZ) {
+    table_sz = MIN_SHARD_TABLE_SZ;
+  }
+  size_t chunk_sz = DEFAULT_SHARD_CHUNK_SIZE;
+  if (0 != expected_bytes) {
+    chunk_sz =
+        (expected_bytes + expected_strings * sizeof(_Header)) / NUM_SHARDS;
+  }
+  if (chunk_sz < MIN_CHUNK_SIZE) {
+    chunk_sz = MIN_CHUNK_SIZE;
+  }
+  _intern_pool_init(pool, table_sz, chunk_sz, refcounted);
+  return pool;
+}
+
+InternPool *intern_pool_create(size_t expected_strings, size_t expected_bytes) {
+  return _pool_create(expected_strings, expected_bytes, false);
+}
+
+InternPool *intern_pool_create_refcounted(size_t expected_strings,
+                                          size_t expected_bytes) {
+  return _pool_create(expected_strings, expected_bytes, true);
+}
+
+void intern_pool_delete(InternPool *pool) {
+  ASSERT_NOT_NULL(pool);
+  _intern_pool_finalize(pool);
+  DEALLOC(pool);
+}
 
 void intern_init() {
-  strings.chunk = strings.last = _chunk_create();
-  strings.tail = strings.chunk->block;
-  strings.end = strings.tail + strings.chunk->sz;
-  set_init(&strings.strings, DEFAULT_HASHTABLE_SIZE, string_hasher,
-           string_comparator, _malloc_fn, _free_fn);
+  _intern_pool_init(&default_pool, DEFAULT_SHARD_TABLE_SZ,
+                    DEFAULT_SHARD_CHUNK_SIZE, false);
+}
+
+void intern_init_refcounted() {
+  _intern_pool_init(&default_pool, DEFAULT_SHARD_TABLE_SZ,
+                    DEFAULT_SHARD_CHUNK_SIZE, true);
+}
+
+void intern_init_with_table(const InternTable *table) {
+  intern_init();
+  if (!intern_pool_load_table(&default_pool, table)) {
+    FATALF("Invalid intern table. Was it generated by an older version?");
+  }
 }
 
-void intern_finalize() {
-  set_finalize(&strings.strings);
-  _chunk_delete(strings.chunk);
+void intern_finalize() { _intern_pool_finalize(&default_pool); }
+
+uint32_t intern_hash(const char str[]) { return _TO_HEADER(str)->hash; }
+
+uint32_t intern_len(const char str[]) { return _TO_HEADER(str)->len; }
+
+uint32_t intern_id(const char str[]) { return _TO_HEADER(str)->id; }
+
+char *intern_str(uint32_t id) { return intern_pool_str(&default_pool, id); }
+
+uint32_t intern_count() { return intern_pool_count(&default_pool); }
+
+char *intern_pool_str(InternPool *pool, uint32_t id) {
+  ASSERT(NOT_NULL(pool), id < atomic_load(&pool->count));
+  if (NULL != pool->image && id < pool->image->count) {
+    return (char *)pool->image->data + pool->image->ids[id];
+  }
+  int segment;
+  uint32_t slot;
+  _id_position(id, &segment, &slot);
+  _Slot *ids =
+      atomic_load_explicit(&pool->id_segments[segment], memory_order_acquire);
+  return atomic_load_explicit(&ids[slot], memory_order_acquire);
+}
+
+uint32_t intern_pool_count(InternPool *pool) {
+  ASSERT_NOT_NULL(pool);
+  return atomic_load(&pool->count);
+}
+
+void intern_stats(InternStats *stats) {
+  intern_pool_stats(&default_pool, stats);
+}
+
+void intern_pool_stats(InternPool *pool, InternStats *stats) {
+  ASSERT(NOT_NULL(pool), NOT_NULL(stats));
+  memset(stats, 0, sizeof(InternStats));
+  int i;
+  for (i = 0; i < NUM_SHARDS; ++i) {
+    _Shard *shard = pool->shards + i;
+    pthread_mutex_lock(&shard->lock);
+    stats->string_count += shard->count;
+    stats->string_bytes += shard->string_bytes;
+    stats->header_bytes +=
+        shard->count *
+        (sizeof(_Header) + (pool->refcounted ? sizeof(_Refs) : 0));
+    stats->chunk_bytes += shard->chunk_bytes;
+    stats->chunk_count += shard->chunk_count + shard->large_count;
+    stats->large_string_count += shard->large_count;
+    stats->wasted_bytes += shard->wasted_bytes;
+    stats->free_bytes += shard->free_bytes;
+    _Table *table;
+    for (table = atomic_load(&shard->table); NULL != table;
+         table = table->retired) {
+      stats->table_bytes += sizeof(_Table) + table->sz * sizeof(_Slot);
+    }
+    pthread_mutex_unlock(&shard->lock);
+  }
+}
+
+uint32_t intern_hasher(const void *ptr) { return _TO_HEADER(ptr)->hash; }
+
+int32_t intern_comparator(const void *ptr1, const void *ptr2) {
+  if (ptr1 == ptr2) {
+    return 0;
+  }
+  return ptr1 < ptr2 ? -1 : 1;
 }
 
 char *intern_range(const char str[], int start, int end) {
-  char *tmp = ALLOC_ARRAY(char, end - start + 1);
-  strncpy(tmp, str + start, end - start);
-  tmp[end - start] = '\0';
-  char *to_return = intern(tmp);
-  DEALLOC(tmp);
-  return to_return;
+  return intern_pool_intern_n(&default_pool, str + start, end - start);
 }
 
 char *intern(const char str[]) {
-  char *str_lookup = (char *)set_lookup(&strings.strings, str);
-  if (NULL != str_lookup) {
-    return str_lookup;
-  }
-  uint32_t len = strlen(str);
-  if (strings.tail + len >= strings.end) {
-    strings.last->next = _chunk_create();
-    strings.last = strings.last->next;
-    strings.tail = strings.last->block;
-    strings.end = strings.tail + strings.last->sz;
-  }
-  char *to_return = strings.tail;
-  memmove(strings.tail, str, len + 1);
-  strings.tail += (len + 1);
-  set_insert(&strings.strings, to_return);
-  return to_return;
+  return intern_pool_intern_n(&default_pool, str, strlen(str));
+}
+
+char *intern_n(const char str[], size_t len) {
+  return intern_pool_intern_n(&default_pool, str, len);
+}
+
+char *intern_pool_intern(InternPool *pool, const char str[]) {
+  return intern_pool_intern_n(pool, str, strlen(str));
+}
+
+char *_pool_intern_hashed(InternPool *pool, const char str[], size_t len,
+                          uint32_t hval) {
+  uint32_t mixed = hash_uint32(hval);
+  if (NULL != pool->image) {
+    char *interned = _image_lookup(pool->image, str, len, hval, mixed);
+    if (NULL != interned) {
+      return interned;
+    }
+  }
+  _Shard *shard = pool->shards + (mixed >> (32 - SHARD_BITS));
+  char *interned;
+  // Strings in refcounted pools can be freed, so they are only read under the
+  // lock.
+  if (!pool->refcounted) {
+    interned = _table_lookup(
+        atomic_load_explicit(&shard->table, memory_order_acquire), str, len,
+        hval, mixed);
+    if (NULL != interned) {
+      return interned;
+    }
+  }
+  pthread_mutex_lock(&shard->lock);
+  // Another thread may have inserted it before the lock was taken.
+  _Table *table = atomic_load_explicit(&shard->table, memory_order_relaxed);
+  interned = _table_lookup(table, str, len, hval, mixed);
+  if (NULL != interned && pool->refcounted) {
+    // Also revives strings which are waiting to be collected.
+    atomic_fetch_add(&_TO_REFS(interned)->refs, 1);
+  } else if (NULL == interned) {
+    interned =
+        _shard_copy(shard, pool->chunk_sz, pool->refcounted, str, len, hval);
+    // Before the string is published so that any thread which finds it can
+    // also find it by id.
+    _pool_assign_id(pool, interned);
+    if ((shard->count + 1) * 2 > table->sz) {
+      table = _shard_grow(shard);
+    }
+    _table_put(table, interned, mixed);
+    shard->count++;
+  }
+  pthread_mutex_unlock(&shard->lock);
+  return interned;
+}
+
+char *intern_pool_intern_n(InternPool *pool, const char str[], size_t len) {
+  ASSERT_NOT_NULL(pool);
+  return _pool_intern_hashed(pool, str, len, string_hasher_len(str, len));
+}
+
+void intern_release(const char str[]) {
+  intern_pool_release(&default_pool, str);
+}
+
+uint32_t intern_collect() { return intern_pool_collect(&default_pool); }
+
+void intern_pool_release(InternPool *pool, const char str[]) {
+  ASSERT(NOT_NULL(pool), NOT_NULL(str));
+  if (!pool->refcounted) {
+    FATALF("Strings can only be released from refcounted intern pools.");
+  }
+  if (NULL != pool->image && intern_id(str) < pool->image->count) {
+    // Loaded strings are never freed.
+    return;
+  }
+  if (0 == atomic_fetch_sub(&_TO_REFS(str)->refs, 1)) {
+    FATALF("Released '%s' more times than it was interned.", str);
+  }
+}
+
+uint32_t intern_pool_collect(InternPool *pool) {
+  ASSERT_NOT_NULL(pool);
+  if (!pool->refcounted) {
+    FATALF("Only refcounted intern pools can be collected.");
+  }
+  uint32_t collected = 0;
+  int i;
+  for (i = 0; i < NUM_SHARDS; ++i) {
+    _Shard *shard = pool->shards + i;
+    pthread_mutex_lock(&shard->lock);
+    collected += _shard_collect(pool, shard);
+    pthread_mutex_unlock(&shard->lock);
+  }
+  return collected;
+}
+
+// Returns the first occurrence of [delim] in [start, end), or [end] if there is
+// none.
+const char *_find_delim(const char *start, const char *end, char delim) {
+  const char *ptr = start;
+#if defined(__AVX2__) && defined(_COUNT_TRAILING_ZEROS)
+  __m256i needle = _mm256_set1_epi8(delim);
+  for (; ptr + 32 <= end; ptr += 32) {
+    __m256i chars = _mm256_loadu_si256((const __m256i *)ptr);
+    uint32_t mask =
+        (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(chars, needle));
+    if (0 != mask) {
+      return ptr + _COUNT_TRAILING_ZEROS(mask);
+    }
+  }
+#elif defined(__SSE2__) && defined(_COUNT_TRAILING_ZEROS)
+  __m128i needle = _mm_set1_epi8(delim);
+  for (; ptr + 16 <= end; ptr += 16) {
+    __m128i chars = _mm_loadu_si128((const __m128i *)ptr);
+    uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(chars, needle));
+    if (0 != mask) {
+      return ptr + _COUNT_TRAILING_ZEROS(mask);
+    }
+  }
+#endif
+  const char *found = (const char *)memchr(ptr, delim, end - ptr);
+  return NULL == found ? end : found;
+}
+
+size_t intern_bulk(const char buf[], size_t len, char delim, char *out[],
+                   size_t max) {
+  return intern_pool_bulk(&default_pool, buf, len, delim, out, max);
+}
+
+size_t intern_pool_bulk(InternPool *pool, const char buf[], size_t len,
+                        char delim, char *out[], size_t max) {
+  ASSERT(NOT_NULL(pool), NOT_NULL(buf), NOT_NULL(out));
+  const char *ptr = buf, *end = buf + len;
+  const char *tokens[BULK_BATCH_SZ];
+  size_t lens[BULK_BATCH_SZ];
+  uint32_t hvals[BULK_BATCH_SZ];
+  size_t count = 0;
+  while (count < max && ptr < end) {
+    // Find and hash a batch of tokens, prefetching the slot each one is most
+    // likely to be found in so the cache misses overlap.
+    int batch_sz = 0;
+    while (batch_sz < BULK_BATCH_SZ && count + batch_sz < max && ptr < end) {
+      const char *token_end = _find_delim(ptr, end, delim);
+      if (token_end != ptr) {
+        tokens[batch_sz] = ptr;
+        lens[batch_sz] = token_end - ptr;
+        hvals[batch_sz] = string_hasher_len(ptr, lens[batch_sz]);
+        // Tables in refcounted pools can be freed, so they are only read under
+        // the lock.
+        if (!pool->refcounted) {
+          uint32_t mixed = hash_uint32(hvals[batch_sz]);
+          _Table *table = atomic_load_explicit(
+              &pool->shards[mixed >> (32 - SHARD_BITS)].table,
+              memory_order_acquire);
+          _PREFETCH(&table->slots[mixed & (table->sz - 1)]);
+        }
+        batch_sz++;
+      }
+      ptr = (token_end == end) ? end : token_end + 1;
+    }
+    int i;
+    for (i = 0; i < batch_sz; ++i) {
+      out[count++] = _pool_intern_hashed(pool, tokens[i], lens[i], hvals[i]);
+    }
+  }
+  return count;
+}
+
+bool intern_save(const char path[]) {
+  return intern_pool_save(&default_pool, path);
 }
+
+bool intern_load_mmap(const char path[]) {
+  return intern_pool_load_mmap(&default_pool, path);
+}
+
+// Returns true if [len] bytes at [offset] fit in [sz] bytes.
+bool _image_range_ok(uint64_t offset, uint64_t len, uint64_t sz) {
+  return offset <= sz && len <= sz - offset;
+}
+
+// Returns true if [offset] into the [data_sz] bytes of [data] is the start of
+// a string whose _Header and terminating NUL are also inside [data], and
+// whose id is [id], or any id below [count] if [id] is UINT32_MAX.
+bool _image_string_ok(const char *data, uint64_t data_sz, uint32_t offset,
+                      uint32_t id, uint32_t count) {
+  if (offset < sizeof(_Header) || offset >= data_sz ||
+      0 != offset % _Alignof(_Header)) {
+    return false;
+  }
+  const _Header *header = _TO_HEADER(data + offset);
+  if (UINT32_MAX == id ? header->id >= count : header->id != id) {
+    return false;
+  }
+  return _image_range_ok(offset, (uint64_t)header->len + 1, data_sz) &&
+         '\0' == data[offset + header->len];
+}
+
+// Returns true if every offset in the header of the [sz] bytes at [bytes], and
+// every string offset in its index and ids, stays inside the image.
+bool _image_ok(const void *bytes, size_t sz) {
+  const _ImageHeader *header = (const _ImageHeader *)bytes;
+  if (0 != (uintptr_t)bytes % sizeof(uint64_t) || sz < sizeof(_ImageHeader) ||
+      INTERN_IMAGE_MAGIC != header->magic ||
+      INTERN_IMAGE_VERSION != header->version || sz != header->file_sz ||
+      header->table_sz != _next_power_of_2(header->table_sz) ||
+      header->count >= header->table_sz ||
+      header->max_probes > header->table_sz ||
+      header->data_offset < sizeof(_ImageHeader) ||
+      0 != header->data_offset % sizeof(uint64_t) ||
+      !_image_range_ok(header->data_offset, header->data_sz, sz) ||
+      header->table_offset < header->data_offset + header->data_sz ||
+      0 != header->table_offset % sizeof(uint32_t) ||
+      !_image_range_ok(header->table_offset,
+                       (uint64_t)header->table_sz * sizeof(uint32_t), sz) ||
+      header->ids_offset <
+          header->table_offset + header->table_sz * sizeof(uint32_t) ||
+      0 != header->ids_offset % sizeof(uint32_t) ||
+      !_image_range_ok(header->ids_offset,
+                       (uint64_t)header->count * sizeof(uint32_t), sz) ||
+      header->ids_offset + header->count * sizeof(uint32_t) != sz) {
+    return false;
+  }
+  const char *data = (const char *)bytes + header->data_offset;
+  const uint32_t *table =
+      (const uint32_t *)((const char *)bytes + header->table_offset);
+  const uint32_t *ids =
+      (const uint32_t *)((const char *)bytes + header->ids_offset);
+  uint32_t i;
+  for (i = 0; i < header->table_sz; ++i) {
+    if (0 != table[i] && !_image_string_ok(data, header->data_sz, table[i],
+                                           UINT32_MAX, header->count)) {
+      return false;
+    }
+  }
+  for (i = 0; i < header->count; ++i) {
+    if (!_image_string_ok(data, header->data_sz, ids[i], i, header->count)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Validates the image in [bytes] and returns a new _Image over it, or NULL if
+// it is not a valid image.
+_Image *_image_create(const void *bytes, size_t sz) {
+  if (!_image_ok(bytes, sz)) {
+    return NULL;
+  }
+  const _ImageHeader *header = (const _ImageHeader *)bytes;
+  _Image *image = ALLOC2(_Image);
+  image->map = NULL;
+  image->map_sz = 0;
+  image->data = (const char *)bytes + header->data_offset;
+  image->table = (const uint32_t *)((const char *)bytes + header->table_offset);
+  image->ids = (const uint32_t *)((const char *)bytes + header->ids_offset);
+  image->table_sz = header->table_sz;
+  image->count = header->count;
+  image->max_probes = header->max_probes;
+  return image;
+}
+
+void _pool_set_image(InternPool *pool, _Image *image) {
+  pool->image = image;
+  // Strings added from here on get the ids after the loaded ones.
+  atomic_store(&pool->count, image->count);
+}
+
+bool intern_pool_load_table(InternPool *pool, const InternTable *table) {
+  ASSERT(NOT_NULL(pool), NOT_NULL(table));
+  if (0 != intern_pool_count(pool) || NULL != pool->image) {
+    FATALF("Intern tables can only be loaded into an empty pool.");
+  }
+  _Image *image = _image_create(table->image, table->image_sz);
+  if (NULL == image) {
+    return false;
+  }
+  _pool_set_image(pool, image);
+  return true;
+}
+
+#ifndef _WIN32
+
+// Indexes the strings of [pool] laid out at [ids] in [table], returning the
+// longest probe sequence.
+uint32_t _image_fill_table(InternPool *pool, const uint32_t ids[],
+                           uint32_t count, uint32_t table[],
+                           uint32_t table_sz) {
+  uint32_t mask = table_sz - 1;
+  uint32_t max_probes = 0;
+  uint32_t id;
+  for (id = 0; id < count; ++id) {
+    uint32_t i = hash_uint32(intern_hash(intern_pool_str(pool, id))) & mask;
+    uint32_t probes = 1;
+    while (0 != table[i]) {
+      i = (i + 1) & mask;
+      probes++;
+    }
+    table[i] = ids[id];
+    if (probes > max_probes) {
+      max_probes = probes;
+    }
+  }
+  return max_probes;
+}
+
+// Returns the number of strings in [pool] once every one of them has been
+// published.
+//
+// Ids are claimed and published under a shard lock, so holding every lock
+// waits out interns which are still publishing. Strings in pools which are
+// not refcounted are never moved or freed, so they can be read after the locks
+// are released.
+uint32_t _pool_published_count(InternPool *pool) {
+  int i;
+  for (i = 0; i < NUM_SHARDS; ++i) {
+    pthread_mutex_lock(&pool->shards[i].lock);
+  }
+  uint32_t count = intern_pool_count(pool);
+  for (i = NUM_SHARDS - 1; i >= 0; --i) {
+    pthread_mutex_unlock(&pool->shards[i].lock);
+  }
+  return count;
+}
+
+bool intern_pool_save(InternPool *pool, const char path[]) {
+  ASSERT(NOT_NULL(pool), NOT_NULL(path));
+  if (pool->refcounted) {
+    // Ids of collected strings leave holes which an image cannot have.
+    return false;
+  }
+  // Strings interned while saving are left out.
+  _ImageHeader header = {.magic = INTERN_IMAGE_MAGIC,
+                         .version = INTERN_IMAGE_VERSION,
+                         .count = _pool_published_count(pool)};
+  // Lay the strings out by id.
+  uint32_t *ids = ALLOC_ARRAY(uint32_t, header.count + 1);
+  size_t data_sz = 0;
+  uint32_t id;
+  for (id = 0; id < header.count; ++id) {
+    char *interned = intern_pool_str(pool, id);
+    ASSERT_NOT_NULL(interned);
+    data_sz = _ALIGN_UP_SZ(data_sz, _Alignof(_Header)) + sizeof(_Header);
+    ids[id] = data_sz;
+    data_sz += intern_len(interned) + 1;
+  }
+  // Prefer a somewhat larger index if it gives every string its own slot.
+  uint32_t min_table_sz = _next_power_of_2(header.count * 2 + 1);
+  uint32_t *table = NULL;
+  for (header.table_sz = min_table_sz;
+       header.table_sz <= min_table_sz * MAX_IMAGE_TABLE_GROWTH;
+       header.table_sz *= 2) {
+    if (NULL != table) {
+      DEALLOC(table);
+    }
+    table = ALLOC_ARRAY(uint32_t, header.table_sz);
+    header.max_probes =
+        _image_fill_table(pool, ids, header.count, table, header.table_sz);
+    if (header.max_probes <= 1) {
+      break;
+    }
+  }
+  if (header.table_sz > min_table_sz * MAX_IMAGE_TABLE_GROWTH) {
+    DEALLOC(table);
+    header.table_sz = min_table_sz;
+    table = ALLOC_ARRAY(uint32_t, header.table_sz);
+    header.max_probes =
+        _image_fill_table(pool, ids, header.count, table, header.table_sz);
+  }
+  header.data_offset = _ALIGN_UP_SZ(sizeof(_ImageHeader), sizeof(uint64_t));
+  header.data_sz = data_sz;
+  header.table_offset =
+      _ALIGN_UP_SZ(header.data_offset + data_sz, sizeof(uint64_t));
+  header.ids_offset = header.table_offset + header.table_sz * sizeof(uint32_t);
+  header.file_sz = header.ids_offset + header.count * sizeof(uint32_t);
+
+  bool ok = data_sz <= UINT32_MAX;
+  FILE *file = ok ? fopen(path, "wb") : NULL;
+  ok = ok && NULL != file;
+  ok = ok && 1 == fwrite(&header, sizeof(_ImageHeader), 1, file);
+  for (id = 0; ok && id < header.count; ++id) {
+    char *interned = intern_pool_str(pool, id);
+    _Header *str_header = _TO_HEADER(interned);
+    ok = 0 == fseek(file, header.data_offset + ids[id] - sizeof(_Header),
+                    SEEK_SET) &&
+         1 == fwrite(str_header, sizeof(_Header) + str_header->len + 1, 1,
+                     file);
+  }
+  ok = ok && 0 == fseek(file, header.table_offset, SEEK_SET);
+  ok = ok && header.table_sz ==
+                 fwrite(table, sizeof(uint32_t), header.table_sz, file);
+  ok = ok && header.count == fwrite(ids, sizeof(uint32_t), header.count, file);
+  if (NULL != file) {
+    ok = 0 == fclose(file) && ok;
+  }
+  DEALLOC(ids);
+  DEALLOC(table);
+  return ok;
+}
+
+bool intern_pool_load_mmap(InternPool *pool, const char path[]) {
+  ASSERT(NOT_NULL(pool), NOT_NULL(path));
+  if (0 != intern_pool_count(pool) || NULL != pool->image) {
+    FATALF("Intern tables can only be loaded into an empty pool.");
+  }
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat file_stat;
+  if (0 != fstat(fd, &file_stat) ||
+      file_stat.st_size < (off_t)sizeof(_ImageHeader)) {
+    close(fd);
+    return false;
+  }
+  void *map = mmap(NULL, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (MAP_FAILED == map) {
+    return false;
+  }
+  _Image *image = _image_create(map, file_stat.st_size);
+  if (NULL == image) {
+    munmap(map, file_stat.st_size);
+    return false;
+  }
+  image->map = map;
+  image->map_sz = file_stat.st_size;
+  _pool_set_image(pool, image);
+  return true;
+}
+
+#else
+
+bool intern_pool_save(InternPool *pool, const char path[]) { return false; }
+
+bool intern_pool_load_mmap(InternPool *pool, const char path[]) {
+  return false;
+}
+
+#endif
@@ -15,13 +15,72 @@
 // char *string2 = intern("unique_string");  // Returns the existing ptr.
 // assert(string1 == string2); // will succeed.
 // intern_finalize();
+//
+// Interning is thread-safe. Strings which are already interned are found
+// without taking a lock. Only intern_init() and intern_finalize() must not race
+// with other calls.
+//
+// Strings can also be interned into separate pools, which have their own
+// table and are freed all at once:
+//
+// InternPool *pool = intern_pool_create(1000, 16000);
+// char *string3 = intern_pool_intern(pool, "unique_string");
+// assert(string3 != string1); // Pools do not share strings.
+// intern_pool_delete(pool);
+//
+// Long-running processes which intern unbounded input can use refcounted pools,
+// which free strings that are no longer referenced. See
+// intern_pool_create_refcounted().
 
 #ifndef ALLOC_ARENA_INTERN_H_
 #define ALLOC_ARENA_INTERN_H_
 
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct __InternPool InternPool;
+
+// A table of strings interned at build time.
+//
+// Tables are generated by the intern_table() Bazel rule in
+// alloc/arena/intern_table.bzl and should not be constructed by hand.
+typedef struct {
+  const void *image;
+  size_t image_sz;
+} InternTable;
+
 // Initializes the string intern.
 void intern_init();
 
+// Initializes the string intern and seeds it with the strings in [table].
+//
+// Details:
+//   - The strings are served directly from [table] without being hashed or
+//     copied at runtime, so the constants generated alongside [table] are the
+//     same pointers that intern() returns for them.
+//   - Strings in [table] get ids 0 to N-1 in the order they were listed.
+//   - Strings in [table] are in read-only memory, so they must not be
+//     modified even though intern() returns them as char *.
+//   - Lookups of strings in [table] usually take a single comparison, since
+//     the generator sizes its index so that no two strings collide when it can.
+//
+// Usage:
+//   // BUILD
+//   load("//alloc/arena:intern_table.bzl", "intern_table")
+//   intern_table(name = "keywords", srcs = ["keywords.txt"])
+//
+//   // main.c
+//   #include "path/to/keywords.h"
+//   intern_init_with_table(&keywords);
+//   assert(KEYWORDS_while == intern("while"));
+void intern_init_with_table(const InternTable *table);
+
+// Initializes the string intern so that its strings are reference counted.
+//
+// See intern_pool_create_refcounted().
+void intern_init_refcounted();
+
 // Finalizes the string intern and frees any relevant memory.
 void intern_finalize();
 
@@ -32,4 +91,218 @@ char *intern(const char str[]);
 // interned string.
 char *intern_range(const char str[], int start, int end);
 
+// Interns the first [len] characters of [str], returning a pointer to the
+// interned string.
+//
+// Details:
+//   - [str] does not need to be null-terminated.
+//   - Does not allocate if the string is already interned.
+char *intern_n(const char str[], size_t len);
+
+// Creates a pool of interned strings separate from the one used by intern().
+//
+// Details:
+//   - [expected_strings] and [expected_bytes] are hints for how many distinct
+//     strings and how many characters in total will be interned. The pool
+//     still grows past them. Pass 0 for the defaults.
+//   - Interned pointers are only unique within the pool.
+//
+// Usage:
+//   InternPool *pool = intern_pool_create(1000, 16000);
+InternPool *intern_pool_create(size_t expected_strings, size_t expected_bytes);
+
+// Creates a pool whose strings are freed once they are no longer referenced.
+//
+// Details:
+//   - Each call that interns a string into the pool returns a new reference to
+//     it, which must be released with intern_pool_release().
+//   - Strings whose references have all been released stay interned until
+//     intern_pool_collect(). Interning one again before then revives it.
+//   - Each string with a live reference still has exactly one copy, so
+//     interned strings can still be compared by pointer.
+//   - Memory and ids of collected strings are reused for new strings, so the
+//     pool's size follows the number of strings that are live at once.
+//   - Lookups take a lock, since a string could otherwise be freed while it is
+//     being compared.
+//   - Strings loaded with intern_pool_load_table() or intern_pool_load_mmap()
+//     are never freed. intern_pool_save() is not supported.
+//
+// Usage:
+//   InternPool *pool = intern_pool_create_refcounted(1000, 16000);
+//   char *key = intern_pool_intern(pool, request_key);
+//   ...
+//   intern_pool_release(pool, key);
+//   ...
+//   intern_pool_collect(pool);  // Periodically.
+InternPool *intern_pool_create_refcounted(size_t expected_strings,
+                                          size_t expected_bytes);
+
+// Frees [pool] and every string interned in it.
+void intern_pool_delete(InternPool *pool);
+
+// Releases a reference to [str], which was interned by intern() after
+// intern_init_refcounted().
+//
+// See intern_pool_create_refcounted().
+void intern_release(const char str[]);
+
+// Frees every string interned by intern() with no remaining references,
+// returning the number freed.
+//
+// See intern_pool_create_refcounted().
+uint32_t intern_collect();
+
+// Same as intern_release() and intern_collect(), but for [pool], which must
+// have been created by intern_pool_create_refcounted().
+void intern_pool_release(InternPool *pool, const char str[]);
+uint32_t intern_pool_collect(InternPool *pool);
+
+// Same as intern() and intern_n(), but interns into [pool].
+char *intern_pool_intern(InternPool *pool, const char str[]);
+char *intern_pool_intern_n(InternPool *pool, const char str[], size_t len);
+
+// Interns each token of [buf] separated by [delim], writing the interned
+// pointers to [out] in order and returning how many were written.
+//
+// Details:
+//   - [buf] does not need to be null-terminated. The last token does not need
+//     to be followed by [delim].
+//   - Empty tokens are skipped.
+//   - Stops after [max] tokens.
+//
+// Usage:
+//   char *symbols[1024];
+//   size_t count = intern_bulk(file_contents, file_len, '\n', symbols, 1024);
+size_t intern_bulk(const char buf[], size_t len, char delim, char *out[],
+                   size_t max);
+
+// Same as intern_bulk(), but interns into [pool].
+size_t intern_pool_bulk(InternPool *pool, const char buf[], size_t len,
+                        char delim, char *out[], size_t max);
+
+// Writes every string interned by intern() to the file at [path], returning
+// true on success.
+//
+// Details:
+//   - The file can be loaded by intern_load_mmap() in another process.
+//   - Strings keep their ids.
+//   - May run while other threads intern. Strings interned after the save
+//     starts may be left out.
+bool intern_save(const char path[]);
+
+// Maps a file written by intern_save() and serves its strings directly from
+// the mapping, returning true on success.
+//
+// Details:
+//   - Must be called after intern_init() and before anything is interned.
+//   - The file is mapped read-only, so loaded strings must not be modified.
+//   - Strings which are not in the file are interned as usual and get ids
+//     after the loaded ones.
+//   - Returns false if the file is missing or is not a valid intern table.
+//
+// Usage:
+//   intern_init();
+//   if (!intern_load_mmap("/tmp/symbols.intern")) {
+//     ... // Intern everything from scratch.
+//     intern_save("/tmp/symbols.intern");
+//   }
+bool intern_load_mmap(const char path[]);
+
+// Same as intern_save() and intern_load_mmap(), but for [pool].
+bool intern_pool_save(InternPool *pool, const char path[]);
+bool intern_pool_load_mmap(InternPool *pool, const char path[]);
+
+// Seeds [pool] with the strings in [table], returning false if [table] is not
+// valid.
+//
+// Details:
+//   - Must be called before anything is interned in [pool].
+//   - See intern_init_with_table().
+bool intern_pool_load_table(InternPool *pool, const InternTable *table);
+
+// Returns the hash of an interned [str] without rehashing it.
+//
+// Details:
+//   - [str] must have been returned by intern(), intern_n(), intern_range(),
+//     or an intern_pool_*() function.
+//   - The hash is the same as string_hasher() would compute.
+uint32_t intern_hash(const char str[]);
+
+// Returns the length of an interned [str] without scanning it.
+//
+// Details:
+//   - [str] must have been returned by intern(), intern_n(), intern_range(),
+//     or an intern_pool_*() function.
+uint32_t intern_len(const char str[]);
+
+// Returns the id of an interned [str].
+//
+// Details:
+//   - Ids are assigned in the order strings are first interned, starting at 0,
+//     so they can index flat arrays and bitsets.
+//   - Ids are only unique within a pool.
+//   - [str] must have been returned by intern(), intern_n(), intern_range(),
+//     or an intern_pool_*() function.
+uint32_t intern_id(const char str[]);
+
+// Returns the string interned by intern() with [id].
+//
+// Details:
+//   - [id] must have been returned by intern_id().
+//   - Returns NULL if the string has been collected. Its id may also have been
+//     reused by a newer string.
+char *intern_str(uint32_t id);
+
+// Returns the number of strings interned by intern(), which is also the next
+// id to be assigned.
+//
+// Details:
+//   - With intern_init_refcounted(), ids of collected strings are reused
+//     first, so this is only an upper bound on ids.
+uint32_t intern_count();
+
+// Same as intern_str() and intern_count(), but for [pool].
+char *intern_pool_str(InternPool *pool, uint32_t id);
+uint32_t intern_pool_count(InternPool *pool);
+
+// How an intern pool is using its memory.
+typedef struct {
+  uint32_t string_count;
+  // Characters in interned strings, including null terminators.
+  size_t string_bytes;
+  // Bytes for the hash, length, id, and reference count stored with each
+  // string.
+  size_t header_bytes;
+  // Bytes allocated for strings, including chunks for single large strings.
+  size_t chunk_bytes;
+  uint32_t chunk_count;
+  // Strings which were too large to share a chunk.
+  uint32_t large_string_count;
+  // Bytes skipped at the end of chunks, for alignment, and for rounding up to
+  // size classes.
+  size_t wasted_bytes;
+  // Bytes freed by intern_pool_collect() which are waiting to be reused.
+  size_t free_bytes;
+  // Bytes for hash tables, including ones which have been replaced.
+  size_t table_bytes;
+} InternStats;
+
+// Fills [stats] for the strings interned by intern().
+void intern_stats(InternStats *stats);
+
+// Fills [stats] for the strings interned in [pool].
+void intern_pool_stats(InternPool *pool, InternStats *stats);
+
+// Hasher and Comparator for Maps and Sets keyed by interned strings.
+//
+// Details:
+//   - Hashing reads the stored hash and comparison is by pointer, as each
+//     interned string has exactly one copy.
+//
+// Usage:
+//   Map map;
+//   map_init_custom_comparator(&map, 51, intern_hasher, intern_comparator);
+uint32_t intern_hasher(const void *ptr);
+int32_t intern_comparator(const void *ptr1, const void *ptr2);
+
 #endif /* ALLOC_ARENA_INTERN_H_ */
@@ -0,0 +1,42 @@
+"""Generates tables of strings which are interned at build time."""
+
+load("@rules_cc//cc:defs.bzl", "cc_library")
+
+def intern_table(name, srcs, visibility = None):
+    """Generates a cc_library holding an InternTable of the strings in srcs.
+
+    Each src is a text file with one string per line. Blank lines are ignored.
+
+    The library's header is <package>/<name>.h. It declares the table as
+    `const InternTable <name>` and defines a `const char *` constant for each
+    string, named by the upper-cased table name and the string with any
+    character that is not valid in an identifier replaced by '_'. After
+    intern_init_with_table(&<name>), each constant equals intern() of its
+    string. The strings are in read-only memory.
+
+    Args:
+      name: The name of the library and of the table. Must be a C identifier.
+      srcs: Text files listing the strings to intern.
+      visibility: The visibility of the library.
+    """
+    native.genrule(
+        name = name + "_gen",
+        srcs = srcs,
+        outs = [name + ".c", name + ".h"],
+        cmd = " ".join([
+            "$(location //alloc/arena:intern_table_gen)",
+            name,
+            native.package_name() + "/" + name + ".h",
+            "$(location " + name + ".c)",
+            "$(location " + name + ".h)",
+            "$(SRCS)",
+        ]),
+        tools = ["//alloc/arena:intern_table_gen"],
+    )
+    cc_library(
+        name = name,
+        srcs = [name + ".c"],
+        hdrs = [name + ".h"],
+        deps = ["//alloc/arena:intern"],
+        visibility = visibility,
+    )
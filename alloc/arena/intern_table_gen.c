@@ -0,0 +1,240 @@
+// intern_table_gen.c
+//
+// Created on: Oct 18, 2026
+//     Author: Jeff Manzione
+//
+// Generates a C source and header holding an InternTable of the strings listed
+// in text files, one string per line. Blank lines are ignored.
+//
+// This is run by the intern_table() Bazel rule in intern_table.bzl.
+//
+// Usage:
+//   intern_table_gen <name> <header include path> <out.c> <out.h> <srcs...>
+
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "alloc/alloc.h"
+#include "alloc/arena/intern.h"
+
+#define BYTES_PER_LINE 16
+
+bool _is_identifier(const char str[]) {
+  if ('\0' == *str || isdigit((unsigned char)*str)) {
+    return false;
+  }
+  for (; '\0' != *str; ++str) {
+    if (!isalnum((unsigned char)*str) && '_' != *str) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Interns each line of the file at [path] into [pool].
+bool _read_strings(InternPool *pool, const char path[]) {
+  FILE *file = fopen(path, "r");
+  if (NULL == file) {
+    fprintf(stderr, "Could not open '%s'.\n", path);
+    return false;
+  }
+  char *line = NULL;
+  size_t line_sz = 0;
+  ssize_t len;
+  while ((len = getline(&line, &line_sz, file)) >= 0) {
+    while (len > 0 && ('\n' == line[len - 1] || '\r' == line[len - 1])) {
+      len--;
+    }
+    if (len > 0) {
+      intern_pool_intern_n(pool, line, len);
+    }
+  }
+  free(line);
+  fclose(file);
+  return true;
+}
+
+// Creates an empty temporary file, writing its path to [path].
+bool _create_temp_file(char path[], size_t path_sz) {
+  const char *dir = getenv("TMPDIR");
+  if (NULL == dir || '\0' == *dir) {
+    dir = "/tmp";
+  }
+  int len = snprintf(path, path_sz, "%s/intern_table_XXXXXX", dir);
+  if (len < 0 || (size_t)len >= path_sz) {
+    return false;
+  }
+  int fd = mkstemp(path);
+  if (fd < 0) {
+    return false;
+  }
+  close(fd);
+  return true;
+}
+
+// Reads the whole file at [path] into an 8-byte aligned buffer.
+uint64_t *_read_image(const char path[], size_t *sz) {
+  FILE *file = fopen(path, "rb");
+  if (NULL == file) {
+    return NULL;
+  }
+  fseek(file, 0, SEEK_END);
+  *sz = ftell(file);
+  fseek(file, 0, SEEK_SET);
+  uint64_t *image =
+      ALLOC_ARRAY2(uint64_t, (*sz + sizeof(uint64_t) - 1) / sizeof(uint64_t));
+  bool ok = *sz == fread(image, 1, *sz, file);
+  fclose(file);
+  if (!ok) {
+    DEALLOC(image);
+    return NULL;
+  }
+  return image;
+}
+
+void _write_source(FILE *file, const char name[], const char include[],
+                   const unsigned char image[], size_t image_sz) {
+  fprintf(file,
+          "// Generated by //alloc/arena:intern_table_gen. Do not edit.\n\n"
+          "#include \"%s\"\n\n"
+          "_Alignas(8) const unsigned char %s_image[%zu] = {",
+          include, name, image_sz);
+  size_t i;
+  for (i = 0; i < image_sz; ++i) {
+    fprintf(file, "%s0x%02x,", (0 == i % BYTES_PER_LINE) ? "\n    " : " ",
+            image[i]);
+  }
+  fprintf(file, "\n};\n\nconst InternTable %s = {%s_image, %zu};\n", name,
+          name, image_sz);
+}
+
+// Writes a macro for each string in [pool], which was loaded from [image].
+bool _write_header(FILE *file, const char name[], InternPool *pool,
+                   const unsigned char image[]) {
+  char prefix[256];
+  size_t prefix_len = strlen(name);
+  if (prefix_len >= sizeof(prefix)) {
+    fprintf(stderr, "Table name '%s' is too long.\n", name);
+    return false;
+  }
+  size_t i;
+  for (i = 0; i <= prefix_len; ++i) {
+    prefix[i] = toupper((unsigned char)name[i]);
+  }
+  fprintf(file,
+          "// Generated by //alloc/arena:intern_table_gen. Do not edit.\n\n"
+          "#ifndef INTERN_TABLE_%s_H_\n"
+          "#define INTERN_TABLE_%s_H_\n\n"
+          "#include \"alloc/arena/intern.h\"\n\n"
+          "extern const unsigned char %s_image[];\n"
+          "extern const InternTable %s;\n\n"
+          "// The strings are in read-only memory and must not be modified.\n",
+          prefix, prefix, name, name);
+  // Macro names are interned separately to catch strings which sanitize to the
+  // same name.
+  InternPool *macros = intern_pool_create(intern_pool_count(pool), 0);
+  bool ok = true;
+  uint32_t id;
+  for (id = 0; ok && id < intern_pool_count(pool); ++id) {
+    char *str = intern_pool_str(pool, id);
+    uint32_t len = intern_len(str);
+    char *macro = ALLOC_ARRAY2(char, prefix_len + len + 2);
+    sprintf(macro, "%s_", prefix);
+    uint32_t j;
+    for (j = 0; j < len; ++j) {
+      unsigned char c = str[j];
+      macro[prefix_len + 1 + j] = (isalnum(c) || '_' == c) ? c : '_';
+    }
+    macro[prefix_len + 1 + len] = '\0';
+    uint32_t count = intern_pool_count(macros);
+    intern_pool_intern(macros, macro);
+    if (count == intern_pool_count(macros)) {
+      fprintf(stderr, "'%s' and another string both map to %s.\n", str,
+              macro);
+      ok = false;
+    } else {
+      fprintf(file, "#define %s ((const char *)%s_image + %zu)\n", macro,
+              name, (size_t)(str - (char *)image));
+    }
+    DEALLOC(macro);
+  }
+  intern_pool_delete(macros);
+  fprintf(file, "\n#endif /* INTERN_TABLE_%s_H_ */\n", prefix);
+  return ok;
+}
+
+int main(int argc, const char *argv[]) {
+  if (argc < 5) {
+    fprintf(stderr,
+            "Usage: %s <name> <header include path> <out.c> <out.h> "
+            "<srcs...>\n",
+            argv[0]);
+    return 1;
+  }
+  const char *name = argv[1], *include = argv[2], *out_c = argv[3],
+             *out_h = argv[4];
+  if (!_is_identifier(name)) {
+    fprintf(stderr, "Table name '%s' is not a C identifier.\n", name);
+    return 1;
+  }
+  alloc_init();
+  // Build the image with the library itself so that it matches what the
+  // library expects to load.
+  InternPool *strings = intern_pool_create(0, 0);
+  bool ok = true;
+  int i;
+  for (i = 5; ok && i < argc; ++i) {
+    ok = _read_strings(strings, argv[i]);
+  }
+  // The image goes through a temporary file so that [out_c] only ever holds
+  // C source.
+  char image_path[4096];
+  bool has_image_path =
+      ok && _create_temp_file(image_path, sizeof(image_path));
+  ok = has_image_path && intern_pool_save(strings, image_path);
+  intern_pool_delete(strings);
+  size_t image_sz = 0;
+  uint64_t *image = ok ? _read_image(image_path, &image_sz) : NULL;
+  ok = NULL != image;
+  if (has_image_path) {
+    remove(image_path);
+  }
+  // Reload the image to find where each string lives in it.
+  InternPool *loaded = intern_pool_create(0, 0);
+  InternTable table = {image, image_sz};
+  ok = ok && intern_pool_load_table(loaded, &table);
+
+  FILE *source = ok ? fopen(out_c, "w") : NULL;
+  FILE *header = ok ? fopen(out_h, "w") : NULL;
+  ok = ok && NULL != source && NULL != header;
+  if (ok) {
+    _write_source(source, name, include, (const unsigned char *)image,
+                  image_sz);
+    ok = _write_header(header, name, loaded, (const unsigned char *)image);
+  }
+  if (NULL != source) {
+    ok = 0 == fclose(source) && ok;
+  }
+  if (NULL != header) {
+    ok = 0 == fclose(header) && ok;
+  }
+  intern_pool_delete(loaded);
+  if (NULL != image) {
+    DEALLOC(image);
+  }
+  alloc_finalize();
+  if (!ok) {
+    // Leaves no partial outputs behind.
+    remove(out_c);
+    remove(out_h);
+    fprintf(stderr, "Failed to generate intern table '%s'.\n", name);
+    return 1;
+  }
+  return 0;
+}
@@ -18,6 +18,8 @@
 #define DEFAULT_NODE_TABLE_SZ 997
 #define DEFAULT_ROOT_TABLE_SZ DEFAULT_TABLE_SZ
 #define DEFAULT_CHILDREN_TABLE_SZ 17
+// Nodes whose marks are looked up together during the sweep.
+#define SWEEP_BATCH_SZ 64
 
 typedef Node *(*NProducer)();
 
@@ -61,6 +63,8 @@ MGraph *mgraph_create(const MGraphConf *const config) {
   __arena_init(&mg->edge_arena, sizeof(_Edge), "_Edge");
   set_init_custom_comparator(&mg->nodes, DEFAULT_NODE_TABLE_SZ, default_hasher,
                              default_comparator);
+  set_use_engine(&mg->nodes, MAP_ENGINE_SWISS);
+  set_use_unordered(&mg->nodes);
   set_init_custom_comparator(&mg->roots, DEFAULT_ROOT_TABLE_SZ, default_hasher,
                              default_comparator);
   mg->node_count = 0;
@@ -152,20 +156,34 @@ uint32_t mgraph_collect_garbage(MGraph *mg) {
   Set marked;
   set_init_custom_comparator(&marked, set_size(&mg->nodes) * 2, default_hasher,
                              default_comparator);
+  // Every node is looked up in [marked] during the sweep.
+  set_use_engine(&marked, MAP_ENGINE_SWISS);
+  set_use_unordered(&marked);
   M_iter root_iter = set_iter(&mg->roots);
   for (; has(&root_iter); inc(&root_iter)) {
     _process_node((Node *)value(&root_iter), &marked);
   }
+  // Nodes are gathered before any is removed so that the removals do not
+  // disturb the iterator.
+  const void *nodes[SWEEP_BATCH_SZ];
+  bool is_marked[SWEEP_BATCH_SZ];
   M_iter node_iter = set_iter(&mg->nodes);
-  for (; has(&node_iter); inc(&node_iter)) {
-    Node *node = (Node *)value(&node_iter);
-    if (set_lookup(&marked, node)) {
-      continue;
+  while (has(&node_iter)) {
+    uint32_t num_nodes = 0, i;
+    for (; num_nodes < SWEEP_BATCH_SZ && has(&node_iter); inc(&node_iter)) {
+      nodes[num_nodes++] = value(&node_iter);
+    }
+    set_contains_batch(&marked, nodes, num_nodes, is_marked);
+    for (i = 0; i < num_nodes; ++i) {
+      if (is_marked[i]) {
+        continue;
+      }
+      Node *node = (Node *)nodes[i];
+      _node_delete(mg, node, mg->config.eager_delete_edges,
+                   mg->config.eager_delete_nodes);
+      set_remove(&mg->nodes, node);
+      deleted_nodes_count++;
     }
-    _node_delete(mg, node, mg->config.eager_delete_edges,
-                 mg->config.eager_delete_nodes);
-    set_remove(&mg->nodes, node);
-    deleted_nodes_count++;
   }
   set_finalize(&marked);
 
@@ -199,10 +217,15 @@ Node *_node_create(MGraph *mg, Ref ptr, Deleter del) {
   node->id.int_id = _node_id(mg);
   node->ptr = ptr;
   node->del = del;
+  // Most nodes have only a few edges.
   map_init_custom_comparator(&node->children, DEFAULT_CHILDREN_TABLE_SZ,
                              default_hasher, default_comparator);
+  map_use_unordered(&node->children);
+  map_use_small(&node->children);
   map_init_custom_comparator(&node->parents, DEFAULT_CHILDREN_TABLE_SZ,
                              default_hasher, default_comparator);
+  map_use_unordered(&node->parents);
+  map_use_small(&node->parents);
   return node;
 }
 
@@ -0,0 +1,439 @@
+// concurrent_map.c
+//
+// Created on: Oct 18, 2026
+//     Author: Jeff Manzione
+
+#include "struct/concurrent_map.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define _CPU_RELAX() _mm_pause()
+#elif defined(__aarch64__)
+#define _CPU_RELAX() __asm__ __volatile__("yield")
+#else
+#include <sched.h>
+#define _CPU_RELAX() sched_yield()
+#endif
+
+#include "debug/debug.h"
+#include "util/util.h"
+
+// Hashes are spread by hash_uint32(). The high bits of the result pick the
+// shard and the low bits pick the slot.
+#define SHARD_BITS 4
+#define NUM_SHARDS (1 << SHARD_BITS)
+// Must be a power of 2.
+#define MIN_SHARD_TABLE_SZ 8
+// Threads which can look up without locking at the same time. Lookups from
+// any further threads lock the shard instead.
+#define MAX_READERS 256
+#define CACHE_LINE_SZ 64
+
+#define SLOT_EMPTY 0
+#define SLOT_FULL 1
+#define SLOT_REMOVED 2
+
+// Every field is atomic since lookups read slots while they are written. The
+// shard's sequence number tells a lookup whether what it read was consistent.
+typedef struct {
+  _Atomic uint32_t state, hash_value;
+  _Atomic(const void *) key;
+  _Atomic(void *) value;
+} _CSlot;
+
+// An open-addressing table with linear probing.
+typedef struct __CTable _CTable;
+
+struct __CTable {
+  // Links tables which were replaced but may still be read.
+  _CTable *next_retired;
+  uint32_t sz;
+  _CSlot slots[];
+};
+
+typedef struct {
+  // Odd while the shard is being written.
+  _Atomic uint32_t seq;
+  _Atomic(_CTable *) table;
+  pthread_mutex_t lock;
+  _Atomic uint32_t count;
+  // Slots which are not empty, including those left by removed entries.
+  uint32_t used;
+  _CTable *retired;
+  // Keeps writes to one shard from invalidating the cache line of the next.
+  char padding[CACHE_LINE_SZ];
+} _CShard;
+
+struct __ConcurrentMap {
+  Hasher hash;
+  Comparator compare;
+  Alloc alloc;
+  Dealloc dealloc;
+  _CShard shards[NUM_SHARDS];
+};
+
+// A hazard pointer: the table a thread is currently reading, which must not be
+// freed until the thread is done with it.
+typedef struct {
+  _Alignas(CACHE_LINE_SZ) _Atomic(_CTable *) table;
+  atomic_bool in_use;
+} _CReader;
+
+// Shared by every map, since a thread only reads one table at a time.
+static _CReader _readers[MAX_READERS];
+static _Thread_local _CReader *_reader = NULL;
+// Lookups nested in a hasher or comparator lock instead, so that the outer
+// lookup's table stays protected.
+static _Thread_local uint32_t _read_depth = 0;
+static pthread_once_t _reader_key_once = PTHREAD_ONCE_INIT;
+// Releases a thread's reader when it exits.
+static pthread_key_t _reader_key;
+
+void _cmap_release_reader(void *reader) {
+  _CReader *me = (_CReader *)reader;
+  atomic_store_explicit(&me->table, NULL, memory_order_release);
+  atomic_store_explicit(&me->in_use, false, memory_order_release);
+}
+
+void _cmap_create_reader_key() {
+  if (0 != pthread_key_create(&_reader_key, _cmap_release_reader)) {
+    FATALF("Could not create concurrent map reader key.");
+  }
+}
+
+// Returns the reader of the calling thread, claiming one on first use, or NULL
+// if every reader is claimed.
+_CReader *_cmap_reader() {
+  if (NULL != _reader) {
+    return _reader;
+  }
+  pthread_once(&_reader_key_once, _cmap_create_reader_key);
+  int i;
+  for (i = 0; i < MAX_READERS; ++i) {
+    bool in_use = false;
+    if (atomic_compare_exchange_strong(&_readers[i].in_use, &in_use, true)) {
+      _reader = &_readers[i];
+      pthread_setspecific(_reader_key, _reader);
+      return _reader;
+    }
+  }
+  return NULL;
+}
+
+// Returns the current table of [shard] once [reader] protects it.
+_CTable *_cmap_protect(_CReader *reader, _CShard *shard) {
+  _CTable *table = atomic_load_explicit(&shard->table, memory_order_acquire);
+  while (true) {
+    atomic_store(&reader->table, table);
+    // The table may have been retired before it was protected.
+    _CTable *current = atomic_load(&shard->table);
+    if (current == table) {
+      return table;
+    }
+    table = current;
+  }
+}
+
+bool _cmap_is_read(const _CTable *table) {
+  int i;
+  for (i = 0; i < MAX_READERS; ++i) {
+    if (table == atomic_load(&_readers[i].table)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Must hold the shard lock. Frees the retired tables no reader is using.
+void _cmap_reclaim(ConcurrentMap *map, _CShard *shard) {
+  _CTable **table = &shard->retired;
+  while (NULL != *table) {
+    if (_cmap_is_read(*table)) {
+      table = &(*table)->next_retired;
+      continue;
+    }
+    _CTable *unused = *table;
+    *table = unused->next_retired;
+    map->dealloc((void **)&unused);
+  }
+}
+
+uint32_t _cmap_next_power_of_2(uint32_t n) {
+  uint32_t power = MIN_SHARD_TABLE_SZ;
+  while (power < n) {
+    power <<= 1;
+  }
+  return power;
+}
+
+_CTable *_cmap_table_create(ConcurrentMap *map, uint32_t sz) {
+  _CTable *table = (_CTable *)map->alloc(
+      sizeof(_CTable) + sizeof(_CSlot) * sz, 1, "_CTable");
+  table->next_retired = NULL;
+  table->sz = sz;
+  return table;
+}
+
+// Returns the slot holding [key], or NULL. Bounded by the table size, since a
+// lookup may read slots while they are written.
+_CSlot *_cmap_find(const ConcurrentMap *map, _CTable *table, const void *key,
+                   uint32_t hval, uint32_t mixed) {
+  uint32_t mask = table->sz - 1;
+  uint32_t i = mixed & mask;
+  uint32_t probes;
+  for (probes = 0; probes < table->sz; ++probes, i = (i + 1) & mask) {
+    _CSlot *slot = table->slots + i;
+    uint32_t state = atomic_load_explicit(&slot->state, memory_order_relaxed);
+    if (SLOT_EMPTY == state) {
+      return NULL;
+    }
+    if (SLOT_FULL == state &&
+        hval ==
+            atomic_load_explicit(&slot->hash_value, memory_order_relaxed) &&
+        0 == map->compare(key, atomic_load_explicit(&slot->key,
+                                                    memory_order_relaxed))) {
+      return slot;
+    }
+  }
+  return NULL;
+}
+
+// Must hold the shard lock. Returns true if an empty slot was used.
+bool _cmap_put(_CTable *table, const void *key, const void *value,
+               uint32_t hval, uint32_t mixed) {
+  uint32_t mask = table->sz - 1;
+  uint32_t i = mixed & mask;
+  uint32_t state;
+  while (SLOT_FULL == (state = atomic_load_explicit(&table->slots[i].state,
+                                                    memory_order_relaxed))) {
+    i = (i + 1) & mask;
+  }
+  _CSlot *slot = table->slots + i;
+  atomic_store_explicit(&slot->hash_value, hval, memory_order_relaxed);
+  atomic_store_explicit(&slot->key, key, memory_order_relaxed);
+  atomic_store_explicit(&slot->value, (void *)value, memory_order_relaxed);
+  atomic_store_explicit(&slot->state, SLOT_FULL, memory_order_relaxed);
+  return SLOT_EMPTY == state;
+}
+
+// Must hold the shard lock. Replaces the table of [shard] with one without
+// removed entries, doubling it if live entries fill over a quarter of it. The
+// old table is retired until no reader is using it.
+_CTable *_cmap_resize(ConcurrentMap *map, _CShard *shard) {
+  _CTable *old = atomic_load_explicit(&shard->table, memory_order_relaxed);
+  uint32_t count = atomic_load_explicit(&shard->count, memory_order_relaxed);
+  _CTable *table = _cmap_table_create(
+      map, (count + 1) * 4 > old->sz ? old->sz * 2 : old->sz);
+  uint32_t i;
+  for (i = 0; i < old->sz; ++i) {
+    _CSlot *slot = old->slots + i;
+    if (SLOT_FULL !=
+        atomic_load_explicit(&slot->state, memory_order_relaxed)) {
+      continue;
+    }
+    uint32_t hval =
+        atomic_load_explicit(&slot->hash_value, memory_order_relaxed);
+    _cmap_put(table,
+              atomic_load_explicit(&slot->key, memory_order_relaxed),
+              atomic_load_explicit(&slot->value, memory_order_relaxed),
+              hval, hash_uint32(hval));
+  }
+  shard->used = count;
+  // Sequentially consistent so that a reader which protects [old] after this
+  // either sees [table] or is seen by _cmap_is_read().
+  atomic_store(&shard->table, table);
+  old->next_retired = shard->retired;
+  shard->retired = old;
+  return table;
+}
+
+// Must hold the shard lock.
+void _cmap_write_begin(_CShard *shard) {
+  uint32_t seq = atomic_load_explicit(&shard->seq, memory_order_relaxed);
+  atomic_store_explicit(&shard->seq, seq + 1, memory_order_relaxed);
+  // Keeps the writes which follow from being seen before [seq] is odd.
+  atomic_thread_fence(memory_order_release);
+}
+
+// Must hold the shard lock.
+void _cmap_write_end(_CShard *shard) {
+  uint32_t seq = atomic_load_explicit(&shard->seq, memory_order_relaxed);
+  atomic_store_explicit(&shard->seq, seq + 1, memory_order_release);
+}
+
+ConcurrentMap *concurrent_map_create(uint32_t size, Hasher hasher,
+                                     Comparator comparator, Alloc alloc,
+                                     Dealloc dealloc) {
+  ConcurrentMap *map =
+      (ConcurrentMap *)alloc(sizeof(ConcurrentMap), 1, "ConcurrentMap");
+  map->hash = hasher;
+  map->compare = comparator;
+  map->alloc = alloc;
+  map->dealloc = dealloc;
+  uint32_t table_sz = _cmap_next_power_of_2(size * 2 / NUM_SHARDS + 1);
+  int i;
+  for (i = 0; i < NUM_SHARDS; ++i) {
+    _CShard *shard = map->shards + i;
+    if (0 != pthread_mutex_init(&shard->lock, NULL)) {
+      FATALF("Could not initialize concurrent map lock.");
+    }
+    atomic_init(&shard->seq, 0);
+    atomic_init(&shard->table, _cmap_table_create(map, table_sz));
+    atomic_init(&shard->count, 0);
+    shard->used = 0;
+    shard->retired = NULL;
+  }
+  return map;
+}
+
+void concurrent_map_delete(ConcurrentMap *map) {
+  ASSERT(NOT_NULL(map));
+  int i;
+  for (i = 0; i < NUM_SHARDS; ++i) {
+    _CShard *shard = map->shards + i;
+    _CTable *table = atomic_load(&shard->table);
+    map->dealloc((void **)&table);
+    while (NULL != shard->retired) {
+      table = shard->retired;
+      shard->retired = table->next_retired;
+      map->dealloc((void **)&table);
+    }
+    pthread_mutex_destroy(&shard->lock);
+  }
+  map->dealloc((void **)&map);
+}
+
+bool concurrent_map_insert(ConcurrentMap *map, const void *key,
+                           const void *value) {
+  ASSERT(NOT_NULL(map));
+  uint32_t hval = map->hash(key);
+  uint32_t mixed = hash_uint32(hval);
+  _CShard *shard = map->shards + (mixed >> (32 - SHARD_BITS));
+  pthread_mutex_lock(&shard->lock);
+  _CTable *table = atomic_load_explicit(&shard->table, memory_order_relaxed);
+  _CSlot *slot = _cmap_find(map, table, key, hval, mixed);
+  // Keeps at least half of the slots empty. Resizing leaves the old table as
+  // it is for lookups still using it, so lookups need not retry during it.
+  if (NULL == slot && (shard->used + 1) * 2 > table->sz) {
+    table = _cmap_resize(map, shard);
+  }
+  _cmap_write_begin(shard);
+  if (NULL != slot) {
+    atomic_store_explicit(&slot->value, (void *)value, memory_order_relaxed);
+  } else {
+    if (_cmap_put(table, key, value, hval, mixed)) {
+      shard->used++;
+    }
+    atomic_fetch_add_explicit(&shard->count, 1, memory_order_relaxed);
+  }
+  _cmap_write_end(shard);
+  if (NULL != shard->retired) {
+    _cmap_reclaim(map, shard);
+  }
+  pthread_mutex_unlock(&shard->lock);
+  return NULL == slot;
+}
+
+Pair concurrent_map_remove(ConcurrentMap *map, const void *key) {
+  ASSERT(NOT_NULL(map));
+  uint32_t hval = map->hash(key);
+  uint32_t mixed = hash_uint32(hval);
+  _CShard *shard = map->shards + (mixed >> (32 - SHARD_BITS));
+  Pair pair = {key, NULL};
+  pthread_mutex_lock(&shard->lock);
+  _CSlot *slot =
+      _cmap_find(map, atomic_load_explicit(&shard->table, memory_order_relaxed),
+                 key, hval, mixed);
+  if (NULL != slot) {
+    pair.key = atomic_load_explicit(&slot->key, memory_order_relaxed);
+    pair.value = atomic_load_explicit(&slot->value, memory_order_relaxed);
+    _cmap_write_begin(shard);
+    atomic_store_explicit(&slot->state, SLOT_REMOVED, memory_order_relaxed);
+    atomic_fetch_sub_explicit(&shard->count, 1, memory_order_relaxed);
+    _cmap_write_end(shard);
+  }
+  if (NULL != shard->retired) {
+    _cmap_reclaim(map, shard);
+  }
+  pthread_mutex_unlock(&shard->lock);
+  return pair;
+}
+
+void *concurrent_map_lookup(const ConcurrentMap *map, const void *key) {
+  ASSERT(NOT_NULL(map));
+  uint32_t hval = map->hash(key);
+  uint32_t mixed = hash_uint32(hval);
+  _CShard *shard = (_CShard *)map->shards + (mixed >> (32 - SHARD_BITS));
+  _CReader *reader = (0 == _read_depth) ? _cmap_reader() : NULL;
+  void *value = NULL;
+  if (NULL == reader) {
+    pthread_mutex_lock(&shard->lock);
+    _CSlot *slot = _cmap_find(
+        map, atomic_load_explicit(&shard->table, memory_order_relaxed), key,
+        hval, mixed);
+    if (NULL != slot) {
+      value = atomic_load_explicit(&slot->value, memory_order_relaxed);
+    }
+    pthread_mutex_unlock(&shard->lock);
+    return value;
+  }
+  _read_depth++;
+  while (true) {
+    uint32_t seq = atomic_load_explicit(&shard->seq, memory_order_acquire);
+    if (1 == (seq & 1)) {
+      _CPU_RELAX();
+      continue;
+    }
+    _CSlot *slot =
+        _cmap_find(map, _cmap_protect(reader, shard), key, hval, mixed);
+    value = (NULL == slot)
+                ? NULL
+                : atomic_load_explicit(&slot->value, memory_order_relaxed);
+    // Keeps the reads above from being satisfied after [seq] is read again.
+    atomic_thread_fence(memory_order_acquire);
+    if (seq == atomic_load_explicit(&shard->seq, memory_order_relaxed)) {
+      break;
+    }
+  }
+  atomic_store_explicit(&reader->table, NULL, memory_order_release);
+  _read_depth--;
+  return value;
+}
+
+uint32_t concurrent_map_size(const ConcurrentMap *map) {
+  ASSERT(NOT_NULL(map));
+  uint32_t size = 0;
+  int i;
+  for (i = 0; i < NUM_SHARDS; ++i) {
+    size += atomic_load_explicit(&map->shards[i].count, memory_order_relaxed);
+  }
+  return size;
+}
+
+void concurrent_map_iterate(ConcurrentMap *map, PairAction pair_action) {
+  ASSERT(NOT_NULL(map));
+  int i;
+  for (i = 0; i < NUM_SHARDS; ++i) {
+    _CShard *shard = map->shards + i;
+    pthread_mutex_lock(&shard->lock);
+    _CTable *table = atomic_load_explicit(&shard->table, memory_order_relaxed);
+    uint32_t j;
+    for (j = 0; j < table->sz; ++j) {
+      _CSlot *slot = table->slots + j;
+      if (SLOT_FULL !=
+          atomic_load_explicit(&slot->state, memory_order_relaxed)) {
+        continue;
+      }
+      Pair pair = {atomic_load_explicit(&slot->key, memory_order_relaxed),
+                   atomic_load_explicit(&slot->value, memory_order_relaxed)};
+      pair_action(&pair);
+    }
+    pthread_mutex_unlock(&shard->lock);
+  }
+}
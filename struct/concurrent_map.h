@@ -0,0 +1,87 @@
+// concurrent_map.h
+//
+// Created on: Oct 18, 2026
+//     Author: Jeff Manzione
+//
+// A hash map which can be shared by threads without an external lock.
+//
+// Entries are partitioned across shards by hash. Insertions and removals lock
+// only their shard, and lookups take no lock at all. A lookup which races with
+// a write to its shard simply retries, so the map suits tables which are read
+// far more often than they are written.
+//
+// ConcurrentMap *map = concurrent_map_create(
+//     64, default_hasher, default_comparator, my_alloc, my_dealloc);
+// concurrent_map_insert(map, key, value);         // From any thread.
+// void *value = concurrent_map_lookup(map, key);  // From any thread.
+// concurrent_map_delete(map);
+
+#ifndef STRUCT_CONCURRENT_MAP_H_
+#define STRUCT_CONCURRENT_MAP_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "struct/map.h"
+#include "util/util.h"
+
+typedef struct __ConcurrentMap ConcurrentMap;
+
+// Creates a concurrent map with room for about [size] entries.
+//
+// Details:
+//   - [alloc] and [dealloc] are called by whichever thread resizes a shard, so
+//     they must be thread-safe.
+//   - [hasher] and [comparator] may run at the same time as writes to the map,
+//     and must not call into the map themselves.
+//   - A lookup may compare against a key which is being removed, so removed
+//     keys must stay valid until lookups which started before the removal
+//     have returned.
+//
+// Usage:
+//   ConcurrentMap *map = concurrent_map_create(
+//       64, my_hasher, my_comparator, my_alloc, my_dealloc);
+ConcurrentMap *concurrent_map_create(uint32_t size, Hasher, Comparator, Alloc,
+                                     Dealloc);
+
+// Frees [map] and its internal memory.
+//
+// Details:
+//   - Must not race with any other call on [map].
+//   - Does not free the memory of items.
+void concurrent_map_delete(ConcurrentMap *map);
+
+// Inserts a [key]-[value] pair into [map] and returns true if [key] was not
+// already present. Otherwise, the value for [key] is replaced.
+//
+// Usage:
+//   concurrent_map_insert(map, some_key_ptr, some_value_ptr);
+bool concurrent_map_insert(ConcurrentMap *map, const void *key,
+                           const void *value);
+
+// Removes [key] from [map] and returns the pair which was stored.
+//
+// Details:
+//   - If [key] is not present, the value of the returned pair is NULL.
+Pair concurrent_map_remove(ConcurrentMap *map, const void *key);
+
+// Returns the value for [key] in [map], or NULL if it is not present.
+//
+// Details:
+//   - Does not lock, and returns the value of [key] as of some point during
+//     the call.
+void *concurrent_map_lookup(const ConcurrentMap *map, const void *key);
+
+// Returns the number of entries in [map].
+//
+// Details:
+//   - Entries inserted or removed during the call may or may not be counted.
+uint32_t concurrent_map_size(const ConcurrentMap *map);
+
+// Applies [pair_action] to each entry in [map], in no particular order.
+//
+// Details:
+//   - Locks one shard at a time, so [pair_action] must not write to [map].
+void concurrent_map_iterate(ConcurrentMap *map, PairAction pair_action);
+
+#endif /* STRUCT_CONCURRENT_MAP_H_ */
@@ -7,25 +7,137 @@
 
 #include <stdbool.h>
 #include <stdint.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define _PREFETCH(ptr) __builtin_prefetch(ptr)
+#else
+#define _PREFETCH(ptr)
+#endif
 
 #include "debug/debug.h"
 #include "util/util.h"
 
+// The start of every slot. Slots are followed by the value unless the map is
+// key-only, and then by _Links if the map is ordered.
 struct __Entry {
-  Pair pair;
   uint32_t hash_value;
   int32_t num_probes;
-  _Entry *prev, *next;
+  const void *key;
 };
 
+// Links an entry to its neighbors in insertion order.
+typedef struct {
+  _Entry *prev, *next;
+} _Links;
+
 #define pos(hval, num_probes, table_sz)                                        \
-  (((hval) + ((num_probes) * (num_probes))) % (table_sz))
-#define calculate_new_size(current_sz) (((current_sz)*2) + 1)
+  (((hval) + ((uint32_t)(num_probes) * (uint32_t)(num_probes))) % (table_sz))
+#define calculate_new_size(current_sz) _next_prime(((current_sz)*2) + 1)
 #define calculate_thresh(table_sz) ((int)((table_sz) / 2.f))
+// Robin Hood table size which holds [num_entries] without resizing.
+#define table_sz_for(num_entries) _next_prime(((num_entries)*2) + 1)
+#define MIN_TABLE_SZ 3
+#define entry_at(map, table, index)                                            \
+  ((_Entry *)((char *)(table) + (size_t)(index) * (map)->entry_sz))
+#define links(map, me)                                                         \
+  ((_Links *)((char *)(me) + (map)->entry_sz - sizeof(_Links)))
+// Only valid if the map has values.
+#define value_slot(me) ((void **)((me) + 1))
+// The key and value are adjacent, so they form the Pair for iterators.
+#define entry_pair(me) ((Pair *)&(me)->key)
+// Slots of the old table moved by each insertion during an incremental resize.
+// This finishes the move well before the new table needs to grow.
+#define MIGRATE_SLOTS 8
+// Keys hashed and prefetched by map_lookup_batch() before any is resolved.
+#define LOOKUP_BATCH_SZ 16
+// Entries held by the flat table of a small map.
+#define SMALL_MAP_SZ 8
+
+#ifdef MAP_COUNT_LOOKUPS
+// Lookups take a const Map, but the map itself is never const.
+#define count_lookup(map, me)                                                  \
+  do {                                                                         \
+    ((Map *)(map))->num_lookups++;                                             \
+    ((Map *)(map))->num_hits += (NULL != (me));                                \
+  } while (0)
+#else
+#define count_lookup(map, me)
+#endif
+
+// Holds an entry while it is carried to its slot.
+typedef union {
+  _Entry entry;
+  char bytes[sizeof(_Entry) + sizeof(void *) + sizeof(_Links)];
+} _EntryBuffer;
 
 typedef void (*EntryAction)(_Entry *me);
 
-void _resize_table(Map *map);
+void _resize_table(Map *map, uint32_t new_table_sz);
+void _map_start_resize(Map *map, uint32_t new_table_sz);
+void _map_migrate(Map *map, uint32_t num_slots);
+void _map_alloc_table(Map *map, uint32_t table_sz);
+_Entry *_map_lookup_entry_hashed(const Map *map, const void *key,
+                                 uint32_t hval, Comparator compare,
+                                 _Entry *table, uint32_t table_sz);
+
+// MAP_ENGINE_SWISS tables have a power-of-2 number of slots, each with an entry
+// and a control byte in a separate array. The control byte is either the low 7
+// bits of hash_uint32(hval), whose remaining bits pick the group, or a marker.
+// Slots are probed in groups of GROUP_SZ control bytes, so most lookups only
+// touch one group and the matching entry.
+#define GROUP_SZ 16
+#define CTRL_EMPTY ((uint8_t)0x80)
+#define CTRL_DELETED ((uint8_t)0xFE)
+#define SLOT_NOT_FOUND UINT32_MAX
+// Leaves at least 1/8 of the slots empty so that probing always ends.
+#define swiss_capacity(table_sz) ((table_sz) / 8 * 7)
+
+// Quadratic probing is only guaranteed to find a free slot in a table which is
+// at most half full if the table size is prime, so Robin Hood tables are always
+// rounded up to one.
+uint32_t _next_prime(uint32_t n) {
+  if (n <= MIN_TABLE_SZ) {
+    return MIN_TABLE_SZ;
+  }
+  if (0 == n % 2) {
+    n++;
+  }
+  while (true) {
+    uint32_t divisor = 3;
+    while (divisor * divisor <= n && 0 != n % divisor) {
+      divisor += 2;
+    }
+    if (divisor * divisor > n) {
+      return n;
+    }
+    n += 2;
+  }
+}
+
+void _map_set_entry_sz(Map *map) {
+  map->entry_sz = sizeof(_Entry) + (map->has_values ? sizeof(void *) : 0) +
+                  (map->is_ordered ? sizeof(_Links) : 0);
+}
+
+// Key-only maps return the key wherever a value is expected.
+void *_entry_value(const Map *map, const _Entry *me) {
+  return map->has_values ? *value_slot(me) : (void *)me->key;
+}
+
+void _entry_set(const Map *map, _Entry *me, const void *key, const void *value,
+                uint32_t hval, int32_t num_probes) {
+  me->key = key;
+  if (map->has_values) {
+    *value_slot(me) = (void *)value;
+  }
+  me->hash_value = hval;
+  me->num_probes = num_probes;
+}
 
 Map *map_create(uint32_t size, Hasher hasher, Comparator comparator,
                 Alloc alloc, Dealloc dealloc) {
@@ -40,12 +152,119 @@ void map_init(Map *map, uint32_t size, Hasher hasher, Comparator comparator,
   map->compare = comparator;
   map->alloc = alloc;
   map->dealloc = dealloc;
-  map->table_sz = size;
-  map->entries_thresh = calculate_thresh(size);
+  map->table_sz = _next_prime(size);
+  map->entries_thresh = calculate_thresh(map->table_sz);
   map->table = NULL; // alloc(sizeof(_Entry), size, "_Entry");
   map->first = NULL;
   map->last = NULL;
   map->num_entries = 0;
+  map->engine = MAP_ENGINE_ROBIN_HOOD;
+  map->ctrl = NULL;
+  map->entries_used = 0;
+  map->is_ordered = true;
+  map->has_values = true;
+  _map_set_entry_sz(map);
+  map->resizes_incrementally = false;
+  map->old_table = NULL;
+  map->old_table_sz = 0;
+  map->old_table_pos = 0;
+  map->is_small = false;
+  map->resize_count = 0;
+#ifdef MAP_COUNT_LOOKUPS
+  map->num_lookups = 0;
+  map->num_hits = 0;
+#endif
+}
+
+void map_use_engine(Map *map, MapEngine engine) {
+  ASSERT(NOT_NULL(map));
+  if (NULL != map->table) {
+    FATALF("Map engine must be set before anything is inserted.");
+  }
+  if (map->resizes_incrementally && MAP_ENGINE_ROBIN_HOOD != engine) {
+    FATALF("Only MAP_ENGINE_ROBIN_HOOD maps can resize incrementally.");
+  }
+  map->engine = engine;
+}
+
+void map_use_incremental_resize(Map *map) {
+  ASSERT(NOT_NULL(map));
+  if (MAP_ENGINE_ROBIN_HOOD != map->engine) {
+    FATALF("Only MAP_ENGINE_ROBIN_HOOD maps can resize incrementally.");
+  }
+  map->resizes_incrementally = true;
+}
+
+void map_use_small(Map *map) {
+  ASSERT(NOT_NULL(map));
+  if (NULL != map->table) {
+    FATALF("Map must be made small before anything is inserted.");
+  }
+  map->is_small = true;
+}
+
+void map_use_unordered(Map *map) {
+  ASSERT(NOT_NULL(map));
+  if (NULL != map->table) {
+    FATALF("Map must be made unordered before anything is inserted.");
+  }
+  map->is_ordered = false;
+  _map_set_entry_sz(map);
+}
+
+void __map_use_key_only(Map *map) {
+  ASSERT(NOT_NULL(map));
+  if (NULL != map->table) {
+    FATALF("Map must be made key-only before anything is inserted.");
+  }
+  map->has_values = false;
+  _map_set_entry_sz(map);
+}
+
+// Appends [me] to the insertion order of an ordered map.
+void _map_link(Map *map, _Entry *me) {
+  links(map, me)->prev = map->last;
+  links(map, me)->next = NULL;
+  if (NULL != map->last) {
+    links(map, map->last)->next = me;
+  }
+  map->last = me;
+  if (NULL == map->first) {
+    map->first = me;
+  }
+}
+
+// Moves the entry in [from] to the unused slot [to], keeping its place in
+// insertion order.
+void _map_move(Map *map, _Entry *from, _Entry *to) {
+  memcpy(to, from, map->entry_sz);
+  if (!map->is_ordered) {
+    return;
+  }
+  _Links *to_links = links(map, to);
+  if (NULL == to_links->prev) {
+    map->first = to;
+  } else {
+    links(map, to_links->prev)->next = to;
+  }
+  if (NULL == to_links->next) {
+    map->last = to;
+  } else {
+    links(map, to_links->next)->prev = to;
+  }
+}
+
+// Puts the entry carried in [carry] into the unused slot [to]. New entries
+// join the end of the insertion order, while others keep their place.
+void _map_place(Map *map, _Entry *carry, _Entry *to, bool is_new) {
+  if (!is_new) {
+    _map_move(map, carry, to);
+    return;
+  }
+  memcpy(to, carry, map->entry_sz);
+  if (map->is_ordered) {
+    _map_link(map, to);
+  }
 }
 
 void map_finalize(Map *map) {
@@ -54,6 +273,12 @@ void map_finalize(Map *map) {
     return;
   }
   map->dealloc((void **)&map->table);
+  if (NULL != map->ctrl) {
+    map->dealloc((void **)&map->ctrl);
+  }
+  if (NULL != map->old_table) {
+    map->dealloc((void **)&map->old_table);
+  }
 }
 
 void map_delete(Map *map) {
@@ -62,101 +287,364 @@ void map_delete(Map *map) {
   map->dealloc((void **)&map);
 }
 
-bool _map_insert_helper(Map *map, const void *key, const void *value,
-                        uint32_t hval, _Entry *table, uint32_t table_sz,
-                        _Entry **first, _Entry **last, bool *too_many_inserts) {
+// Inserts the entry in [carry] into the table of [map]. Entries which are not
+// new, like ones moved out of an old table, are already unique and linked.
+//
+// Returns false if a new entry's key was already present, in which case only
+// the value is updated.
+bool _map_insert_helper(Map *map, _Entry *carry, bool is_new,
+                        bool *too_many_inserts) {
   ASSERT(NOT_NULL(map));
+  uint32_t hval = carry->hash_value;
   int num_probes = 0;
   int num_previously_used = 0;
-  _Entry *first_empty = NULL;
-  int num_probes_at_first_empty = -1;
   while (true) {
-    int table_index = pos(hval, num_probes, table_sz);
+    int table_index = pos(hval, num_probes, map->table_sz);
     num_probes++;
-    _Entry *me = table + table_index;
+    _Entry *me = entry_at(map, map->table, table_index);
     // Position is vacant.
     if (0 == me->num_probes) {
-      // Use the previously empty slot if we don't find our element.
-      if (first_empty != NULL) {
-        me = first_empty;
-        num_probes = num_probes_at_first_empty;
-      }
+      map->entries_used++;
       // Take the vacant spot.
-      me->pair.key = key;
-      me->pair.value = (void *)value;
-      me->hash_value = hval;
-      me->num_probes = num_probes;
-      me->prev = *last;
-      me->next = NULL;
-      if (NULL != *last) {
-        me->prev->next = me;
-      }
-      *last = me;
-      if (NULL == *first) {
-        *first = me;
-      }
+      carry->num_probes = num_probes;
+      _map_place(map, carry, me, is_new);
       return true;
     }
-    // Spot is vacant but previously used, mark it so we can use it later.
+    // Spot is vacant but previously used. It is not reused until the table is
+    // rehashed, since an entry with fewer probes in it could make a later
+    // insertion rob a slot before finding its key further along.
     if (-1 == me->num_probes) {
       num_previously_used++;
       // Returns early if there is a severe performance bottleneck so the table
       // can be rehashed.
-      if (num_previously_used > (table_sz / 2)) {
+      if (num_previously_used > (map->table_sz / 2)) {
         *too_many_inserts = true;
         return false;
       }
-      if (NULL == first_empty) {
-        first_empty = me;
-        num_probes_at_first_empty = num_probes;
-      }
       continue;
     }
     // Pair is already present in the table, so the mission is accomplished.
-    if (hval == me->hash_value) {
-      if (0 == map->compare(key, me->pair.key)) {
-        me->pair.value = (void *)value;
+    if (is_new && hval == me->hash_value) {
+      if (0 == map->compare(carry->key, me->key)) {
+        if (map->has_values) {
+          *value_slot(me) = *value_slot(carry);
+        }
         return false;
       }
     }
-    // Rob this entry if it did fewer probes.
+    // Rob this entry if it did fewer probes. Whole slots are moved so that
+    // both entries keep their place in insertion order.
     if (me->num_probes < num_probes) {
-      _Entry tmp_me = *me;
+      _EntryBuffer robbed;
+      _map_move(map, me, &robbed.entry);
       // Take its spot.
-      me->pair.key = key;
-      me->pair.value = (void *)value;
-      me->hash_value = hval;
-      me->num_probes = num_probes;
+      carry->num_probes = num_probes;
+      _map_place(map, carry, me, is_new);
       // It is the new insertion.
-      key = tmp_me.pair.key;
-      value = tmp_me.pair.value;
-      hval = tmp_me.hash_value;
-      num_probes = tmp_me.num_probes;
-      first_empty = NULL;
-      num_probes_at_first_empty = -1;
+      _map_move(map, &robbed.entry, carry);
+      is_new = false;
+      hval = carry->hash_value;
+      num_probes = carry->num_probes;
+    }
+  }
+}
+
+// Returns a mask with bit i set if byte i of [group] equals [ctrl].
+uint32_t _group_match(const uint8_t group[], uint8_t ctrl) {
+#if defined(__SSE2__)
+  __m128i bytes = _mm_loadu_si128((const __m128i *)group);
+  return (uint32_t)_mm_movemask_epi8(
+      _mm_cmpeq_epi8(bytes, _mm_set1_epi8((char)ctrl)));
+#else
+  uint32_t mask = 0;
+  int i;
+  for (i = 0; i < GROUP_SZ; ++i) {
+    mask |= (uint32_t)(group[i] == ctrl) << i;
+  }
+  return mask;
+#endif
+}
+
+// Returns a mask with bit i set if slot i of [group] is empty or deleted, both
+// of which have the high bit set.
+uint32_t _group_match_free(const uint8_t group[]) {
+#if defined(__SSE2__)
+  return (uint32_t)_mm_movemask_epi8(
+      _mm_loadu_si128((const __m128i *)group));
+#else
+  uint32_t mask = 0;
+  int i;
+  for (i = 0; i < GROUP_SZ; ++i) {
+    mask |= (uint32_t)(group[i] >> 7) << i;
+  }
+  return mask;
+#endif
+}
+
+int _lowest_bit(uint32_t mask) {
+#if defined(__GNUC__) || defined(__clang__)
+  return __builtin_ctz(mask);
+#else
+  int bit = 0;
+  while (0 == (mask & 1)) {
+    mask >>= 1;
+    bit++;
+  }
+  return bit;
+#endif
+}
+
+void _swiss_alloc(Map *map, uint32_t table_sz) {
+  map->table_sz = table_sz;
+  map->entries_thresh = swiss_capacity(table_sz);
+  map->table = map->alloc(map->entry_sz, table_sz, "_Entry");
+  map->ctrl = map->alloc(sizeof(uint8_t), table_sz, "_Ctrl");
+  memset(map->ctrl, CTRL_EMPTY, table_sz);
+  map->entries_used = 0;
+}
+
+// Returns the slot in the index of the entry for [key], or SLOT_NOT_FOUND.
+uint32_t _swiss_find(const Map *map, const void *key, uint32_t hval,
+                     Comparator compare) {
+  uint32_t mixed = hash_uint32(hval);
+  uint8_t tag = mixed & 0x7F;
+  uint32_t group_mask = map->table_sz / GROUP_SZ - 1;
+  uint32_t group = (mixed >> 7) & group_mask;
+  // Triangular steps visit every group of a power-of-2 table.
+  uint32_t step;
+  for (step = 1;; ++step) {
+    const uint8_t *ctrl = map->ctrl + group * GROUP_SZ;
+    uint32_t matches = _group_match(ctrl, tag);
+    while (0 != matches) {
+      uint32_t slot = group * GROUP_SZ + _lowest_bit(matches);
+      _Entry *me = entry_at(map, map->table, slot);
+      if (hval == me->hash_value && 0 == compare(key, me->key)) {
+        return slot;
+      }
+      matches &= matches - 1;
+    }
+    // A key is always placed in the first group with a free slot, so it cannot
+    // be past a group with an empty one.
+    if (0 != _group_match(ctrl, CTRL_EMPTY)) {
+      return SLOT_NOT_FOUND;
+    }
+    group = (group + step) & group_mask;
+  }
+}
+
+// Places a new entry in the first free slot of its probe sequence. There must
+// be room in the table.
+void _swiss_place(Map *map, const void *key, const void *value,
+                  uint32_t hval) {
+  uint32_t mixed = hash_uint32(hval);
+  uint32_t group_mask = map->table_sz / GROUP_SZ - 1;
+  uint32_t group = (mixed >> 7) & group_mask;
+  uint32_t slot;
+  uint32_t step;
+  for (step = 1;; ++step) {
+    uint32_t free_slots = _group_match_free(map->ctrl + group * GROUP_SZ);
+    if (0 != free_slots) {
+      slot = group * GROUP_SZ + _lowest_bit(free_slots);
+      break;
+    }
+    group = (group + step) & group_mask;
+  }
+  if (CTRL_EMPTY == map->ctrl[slot]) {
+    map->entries_used++;
+  }
+  map->ctrl[slot] = mixed & 0x7F;
+  _Entry *me = entry_at(map, map->table, slot);
+  _entry_set(map, me, key, value, hval, 1);
+  if (map->is_ordered) {
+    _map_link(map, me);
+  }
+}
+
+// Rebuilds the table at [table_sz], clearing any deleted slots.
+void _swiss_rehash(Map *map, uint32_t table_sz) {
+  Map old = *map;
+  map->resize_count++;
+  _swiss_alloc(map, table_sz);
+  map->first = NULL;
+  map->last = NULL;
+  M_iter iter;
+  for (iter = map_iter(&old); has(&iter); inc(&iter)) {
+    _Entry *me = iter.__entry;
+    _swiss_place(map, me->key, _entry_value(&old, me), me->hash_value);
+  }
+  map->dealloc((void **)&old.table);
+  map->dealloc((void **)&old.ctrl);
+}
+
+// Returns the smallest table size which holds [num_entries].
+uint32_t _swiss_table_sz(uint32_t num_entries) {
+  uint32_t table_sz = GROUP_SZ;
+  while (swiss_capacity(table_sz) < num_entries) {
+    table_sz *= 2;
+  }
+  return table_sz;
+}
+
+bool _swiss_insert(Map *map, const void *key, const void *value) {
+  uint32_t hval = map->hash(key);
+  if (NULL == map->table) {
+    // Until then, [table_sz] is the size requested for a Robin Hood table.
+    _swiss_alloc(map, _swiss_table_sz(map->table_sz / 2));
+  } else {
+    uint32_t slot = _swiss_find(map, key, hval, map->compare);
+    if (SLOT_NOT_FOUND != slot) {
+      if (map->has_values) {
+        *value_slot(entry_at(map, map->table, slot)) = (void *)value;
+      }
+      return false;
+    }
+  }
+  if (map->entries_used == map->entries_thresh) {
+    // Rehash at the same size if most of the used slots are deleted ones.
+    _swiss_rehash(map, map->num_entries < map->entries_thresh / 2
+                           ? map->table_sz
+                           : map->table_sz * 2);
+  }
+  _swiss_place(map, key, value, hval);
+  map->num_entries++;
+  return true;
+}
+
+// Rehashes [map] once removed entries and live ones fill it. The table only
+// grows if the live entries alone fill more than half of the threshold, so maps
+// with steady insert/remove churn keep their size.
+void _rehash_table(Map *map) {
+  uint32_t new_table_sz = map->num_entries * 2 < map->entries_thresh
+                              ? map->table_sz
+                              : calculate_new_size(map->table_sz);
+  if (map->resizes_incrementally) {
+    _map_start_resize(map, new_table_sz);
+  } else {
+    _resize_table(map, new_table_sz);
+  }
+}
+
+_Entry *_small_find(const Map *map, const void *key, uint32_t hval,
+                    Comparator compare) {
+  uint32_t i;
+  for (i = 0; i < map->entries_used; ++i) {
+    _Entry *me = entry_at(map, map->table, i);
+    if (me->num_probes > 0 && hval == me->hash_value &&
+        0 == compare(key, me->key)) {
+      return me;
+    }
+  }
+  return NULL;
+}
+
+// Moves the entries of a small map into a hash table with room for
+// [num_entries], which the map uses from then on.
+void _small_spill(Map *map, uint32_t num_entries) {
+  Map old = *map;
+  map->resize_count++;
+  map->is_small = false;
+  map->first = NULL;
+  map->last = NULL;
+  if (MAP_ENGINE_SWISS == map->engine) {
+    _swiss_alloc(map, _swiss_table_sz(num_entries));
+  } else {
+    _map_alloc_table(map, table_sz_for(num_entries));
+  }
+  M_iter iter;
+  for (iter = map_iter(&old); has(&iter); inc(&iter)) {
+    _Entry *me = iter.__entry;
+    if (MAP_ENGINE_SWISS == map->engine) {
+      _swiss_place(map, me->key, _entry_value(&old, me), me->hash_value);
+      continue;
+    }
+    _EntryBuffer carry;
+    _entry_set(map, &carry.entry, me->key, _entry_value(&old, me),
+               me->hash_value, 0);
+    bool too_many_inserts = false;
+    _map_insert_helper(map, &carry.entry, true, &too_many_inserts);
+  }
+  map->dealloc((void **)&old.table);
+}
+
+// Entries are appended to the flat table, reusing the slots of removed ones,
+// until it is full.
+bool _small_insert(Map *map, const void *key, const void *value) {
+  uint32_t hval = map->hash(key);
+  if (NULL == map->table) {
+    _map_alloc_table(map, SMALL_MAP_SZ);
+  }
+  _Entry *free_slot = NULL;
+  uint32_t i;
+  for (i = 0; i < map->entries_used; ++i) {
+    _Entry *me = entry_at(map, map->table, i);
+    if (-1 == me->num_probes) {
+      if (NULL == free_slot) {
+        free_slot = me;
+      }
+      continue;
+    }
+    if (hval == me->hash_value && 0 == map->compare(key, me->key)) {
+      if (map->has_values) {
+        *value_slot(me) = (void *)value;
+      }
+      return false;
     }
   }
+  if (NULL == free_slot) {
+    if (SMALL_MAP_SZ == map->entries_used) {
+      _small_spill(map, 2 * SMALL_MAP_SZ);
+      return map_insert(map, key, value);
+    }
+    free_slot = entry_at(map, map->table, map->entries_used++);
+  }
+  _entry_set(map, free_slot, key, value, hval, 1);
+  if (map->is_ordered) {
+    _map_link(map, free_slot);
+  }
+  map->num_entries++;
+  return true;
 }
 
 bool map_insert(Map *map, const void *key, const void *value) {
   ASSERT(NOT_NULL(map));
+  if (map->is_small) {
+    return _small_insert(map, key, value);
+  }
+  if (MAP_ENGINE_SWISS == map->engine) {
+    return _swiss_insert(map, key, value);
+  }
+  _EntryBuffer carry;
+  _entry_set(map, &carry.entry, key, value, map->hash(key), 0);
   if (NULL == map->table) {
-    map->table = map->alloc(sizeof(_Entry), map->table_sz, "_Entry");
-  } else if (map->num_entries > map->entries_thresh) {
-    _resize_table(map);
+    _map_alloc_table(map, map->table_sz);
+  } else {
+    _map_migrate(map, MIGRATE_SLOTS);
+    if (map->entries_used > map->entries_thresh) {
+      _rehash_table(map);
+    }
+  }
+  // Keys not yet moved out of the old table are updated where they are.
+  if (NULL != map->old_table) {
+    _Entry *me = _map_lookup_entry_hashed(map, key, carry.entry.hash_value,
+                                          map->compare, map->old_table,
+                                          map->old_table_sz);
+    if (NULL != me) {
+      if (map->has_values) {
+        *value_slot(me) = (void *)value;
+      }
+      return false;
+    }
   }
   bool too_many_inserts = false;
-  bool was_inserted = _map_insert_helper(map, key, value, map->hash(key),
-                                         map->table, map->table_sz, &map->first,
-                                         &map->last, &too_many_inserts);
+  bool was_inserted =
+      _map_insert_helper(map, &carry.entry, true, &too_many_inserts);
   // Maps may have a lot of removed spots. If this causes a performance
   // slowdown, then it is better to rehash the map.
   if (too_many_inserts) {
-    _resize_table(map);
+    _rehash_table(map);
     too_many_inserts = false;
-    was_inserted = _map_insert_helper(map, key, value, map->hash(key),
-                                      map->table, map->table_sz, &map->first,
-                                      &map->last, &too_many_inserts);
+    was_inserted =
+        _map_insert_helper(map, &carry.entry, true, &too_many_inserts);
     if (too_many_inserts) {
       FATALF("THIS SHOULD NEVER HAPPEN.");
     }
@@ -167,15 +655,17 @@ bool map_insert(Map *map, const void *key, const void *value) {
   return was_inserted;
 }
 
-_Entry *_map_lookup_entry(const Map *map, const void *key, _Entry *table,
-                          uint32_t table_sz) {
+_Entry *_map_lookup_entry_hashed(const Map *map, const void *key,
+                                 uint32_t hval, Comparator compare,
+                                 _Entry *table, uint32_t table_sz) {
   ASSERT(NOT_NULL(map));
-  uint32_t hval = map->hash(key);
-  int num_probes = 0;
-  while (true) {
+  uint32_t num_probes = 0;
+  // Positions repeat after [table_sz] probes, which can happen without finding
+  // an empty slot when many keys share a hash.
+  while (num_probes < table_sz) {
     int table_index = pos(hval, num_probes, table_sz);
     ++num_probes;
-    _Entry *me = table + table_index;
+    _Entry *me = entry_at(map, table, table_index);
     if (0 == me->num_probes) {
       // Found empty.
       return NULL;
@@ -185,11 +675,71 @@ _Entry *_map_lookup_entry(const Map *map, const void *key, _Entry *table,
       continue;
     }
     if (hval == me->hash_value) {
-      if (0 == map->compare(key, me->pair.key)) {
+      if (0 == compare(key, me->key)) {
         return me;
       }
     }
   }
+  return NULL;
+}
+
+// Returns the entry for [key], or NULL, with whichever engine [map] uses.
+_Entry *_map_find(const Map *map, const void *key, uint32_t hval,
+                  Comparator compare) {
+  if (map->is_small) {
+    return _small_find(map, key, hval, compare);
+  }
+  if (MAP_ENGINE_SWISS == map->engine) {
+    uint32_t slot = _swiss_find(map, key, hval, compare);
+    return SLOT_NOT_FOUND == slot ? NULL : entry_at(map, map->table, slot);
+  }
+  _Entry *me = _map_lookup_entry_hashed(map, key, hval, compare, map->table,
+                                        map->table_sz);
+  if (NULL == me && NULL != map->old_table) {
+    me = _map_lookup_entry_hashed(map, key, hval, compare, map->old_table,
+                                  map->old_table_sz);
+  }
+  return me;
+}
+
+void _map_unlink(Map *map, _Entry *me) {
+  if (!map->is_ordered) {
+    return;
+  }
+  _Links *me_links = links(map, me);
+  if (map->last == me) {
+    map->last = me_links->prev;
+  } else {
+    links(map, me_links->next)->prev = me_links->prev;
+  }
+  if (map->first == me) {
+    map->first = me_links->next;
+  } else {
+    links(map, me_links->prev)->next = me_links->next;
+  }
+}
+
+Pair _swiss_remove(Map *map, const void *key) {
+  uint32_t slot = _swiss_find(map, key, map->hash(key), map->compare);
+  if (SLOT_NOT_FOUND == slot) {
+    Pair pair = {key, NULL};
+    return pair;
+  }
+  _Entry *me = entry_at(map, map->table, slot);
+  _map_unlink(map, me);
+  me->num_probes = -1;
+  // Lookups stop at a group with an empty slot, so if this group has one the
+  // slot can be emptied rather than marked.
+  const uint8_t *group = map->ctrl + (slot & ~(uint32_t)(GROUP_SZ - 1));
+  if (0 != _group_match(group, CTRL_EMPTY)) {
+    map->ctrl[slot] = CTRL_EMPTY;
+    map->entries_used--;
+  } else {
+    map->ctrl[slot] = CTRL_DELETED;
+  }
+  map->num_entries--;
+  Pair pair = {me->key, _entry_value(map, me)};
+  return pair;
 }
 
 Pair map_remove(Map *map, const void *key) {
@@ -198,36 +748,95 @@ Pair map_remove(Map *map, const void *key) {
     Pair pair = {key, NULL};
     return pair;
   }
-  _Entry *me = _map_lookup_entry(map, key, map->table, map->table_sz);
+  if (MAP_ENGINE_SWISS == map->engine && !map->is_small) {
+    return _swiss_remove(map, key);
+  }
+  _Entry *me = _map_find(map, key, map->hash(key), map->compare);
   if (NULL == me) {
     Pair pair = {key, NULL};
     return pair;
   }
-  if (map->last == me) {
-    map->last = me->prev;
-  } else {
-    me->next->prev = me->prev;
-  }
-  if (map->first == me) {
-    map->first = me->next;
-  } else {
-    me->prev->next = me->next;
-  }
+  _map_unlink(map, me);
   me->num_probes = -1;
   map->num_entries--;
-  return me->pair;
+  Pair pair = {me->key, _entry_value(map, me)};
+  return pair;
 }
 
 void *map_lookup(const Map *map, const void *key) {
   ASSERT(NOT_NULL(map));
   if (NULL == map->table) {
+    count_lookup(map, NULL);
+    return NULL;
+  }
+  _Entry *me = _map_find(map, key, map->hash(key), map->compare);
+  count_lookup(map, me);
+  if (NULL == me) {
+    return NULL;
+  }
+  return _entry_value(map, me);
+}
+
+void *map_lookup_hashed(const Map *map, const void *key, uint32_t hval,
+                        Comparator comparator) {
+  ASSERT(NOT_NULL(map), NOT_NULL(comparator));
+  if (NULL == map->table) {
+    count_lookup(map, NULL);
     return NULL;
   }
-  _Entry *me = _map_lookup_entry(map, key, map->table, map->table_sz);
+  _Entry *me = _map_find(map, key, hval, comparator);
+  count_lookup(map, me);
   if (NULL == me) {
     return NULL;
   }
-  return me->pair.value;
+  return _entry_value(map, me);
+}
+
+// Prefetches the slots [hval] probes first so that later lookups of it do not
+// wait on memory.
+void _map_prefetch(const Map *map, uint32_t hval) {
+  if (map->is_small) {
+    return;
+  }
+  if (MAP_ENGINE_SWISS == map->engine) {
+    uint32_t group =
+        (hash_uint32(hval) >> 7) & (map->table_sz / GROUP_SZ - 1);
+    _PREFETCH(map->ctrl + group * GROUP_SZ);
+    return;
+  }
+  _PREFETCH(entry_at(map, map->table, pos(hval, 0, map->table_sz)));
+  if (NULL != map->old_table) {
+    _PREFETCH(entry_at(map, map->old_table, pos(hval, 0, map->old_table_sz)));
+  }
+}
+
+void map_lookup_batch(const Map *map, const void *const keys[],
+                      uint32_t num_keys, void *values[]) {
+  ASSERT(NOT_NULL(map), NOT_NULL(keys), NOT_NULL(values));
+  uint32_t i;
+  if (NULL == map->table) {
+    for (i = 0; i < num_keys; ++i) {
+      count_lookup(map, NULL);
+      values[i] = NULL;
+    }
+    return;
+  }
+  uint32_t hvals[LOOKUP_BATCH_SZ];
+  uint32_t start;
+  for (start = 0; start < num_keys; start += LOOKUP_BATCH_SZ) {
+    uint32_t batch_sz = (num_keys - start < LOOKUP_BATCH_SZ)
+                            ? num_keys - start
+                            : LOOKUP_BATCH_SZ;
+    for (i = 0; i < batch_sz; ++i) {
+      hvals[i] = map->hash(keys[start + i]);
+      _map_prefetch(map, hvals[i]);
+    }
+    for (i = 0; i < batch_sz; ++i) {
+      _Entry *me = _map_find(map, keys[start + i], hvals[i], map->compare);
+      count_lookup(map, me);
+      values[start + i] = (NULL == me) ? NULL : _entry_value(map, me);
+    }
+  }
 }
 
 void map_iterate(const Map *map, PairAction action) {
@@ -237,42 +846,251 @@ void map_iterate(const Map *map, PairAction action) {
   }
   M_iter iter;
   for (iter = map_iter((Map *)map); has(&iter); inc(&iter)) {
-    action(&iter.__entry->pair);
+    action(pair(&iter));
   }
 }
 
 uint32_t map_size(const Map *map) { return map->num_entries; }
 
-void _resize_table(Map *map) {
-  ASSERT(NOT_NULL(map));
-  uint32_t new_table_sz = calculate_new_size(map->table_sz);
-  _Entry *new_table = map->alloc(sizeof(_Entry), new_table_sz, "_Entry");
-  _Entry *new_first = NULL;
-  _Entry *new_last = NULL;
+// Returns the number of groups a lookup of the entry in [slot] visits.
+uint32_t _swiss_probes(const Map *map, uint32_t slot, uint32_t hval) {
+  uint32_t group_mask = map->table_sz / GROUP_SZ - 1;
+  uint32_t group = (hash_uint32(hval) >> 7) & group_mask;
+  uint32_t num_probes = 1, step;
+  for (step = 1; group != slot / GROUP_SZ; ++step, ++num_probes) {
+    group = (group + step) & group_mask;
+  }
+  return num_probes;
+}
 
-  M_iter iter = map_iter(map);
-  for (; has(&iter); inc(&iter)) {
-    _Entry *me = iter.__entry;
+// Adds the entries of [table] to [stats], summing their probes into
+// [total_probes]. Slots which were moved out of an old table are not
+// tombstones, since the old table is dropped once all of them are moved.
+void _map_stats_table(const Map *map, _Entry *table, uint32_t table_sz,
+                      bool is_old_table, MapStats *stats,
+                      uint64_t *total_probes) {
+  uint32_t i;
+  for (i = 0; i < table_sz; ++i) {
+    _Entry *me = entry_at(map, table, i);
+    if (me->num_probes <= 0) {
+      // Removed Swiss entries are only tombstones if their slot is marked.
+      if (MAP_ENGINE_SWISS == map->engine && !map->is_small) {
+        stats->tombstones += CTRL_DELETED == map->ctrl[i];
+      } else if (-1 == me->num_probes && !is_old_table) {
+        stats->tombstones++;
+      }
+      continue;
+    }
+    uint32_t num_probes = me->num_probes;
+    if (map->is_small) {
+      num_probes = i + 1;
+    } else if (MAP_ENGINE_SWISS == map->engine) {
+      num_probes = _swiss_probes(map, i, me->hash_value);
+    }
+    *total_probes += num_probes;
+    if (num_probes > stats->max_probes) {
+      stats->max_probes = num_probes;
+    }
+    stats->probe_histogram[num_probes < MAP_STATS_HISTOGRAM_SZ
+                               ? num_probes - 1
+                               : MAP_STATS_HISTOGRAM_SZ - 1]++;
+  }
+}
+
+void map_stats(const Map *map, MapStats *stats) {
+  ASSERT(NOT_NULL(map), NOT_NULL(stats));
+  memset(stats, 0, sizeof(MapStats));
+  stats->num_entries = map->num_entries;
+  stats->resize_count = map->resize_count;
+#ifdef MAP_COUNT_LOOKUPS
+  stats->lookups = map->num_lookups;
+  stats->hits = map->num_hits;
+  stats->misses = map->num_lookups - map->num_hits;
+#endif
+  if (NULL == map->table) {
+    return;
+  }
+  stats->table_sz = map->table_sz;
+  stats->load_factor = ((double)map->num_entries) / map->table_sz;
+  stats->bytes_used = (size_t)map->table_sz * map->entry_sz;
+  if (NULL != map->ctrl) {
+    stats->bytes_used += map->table_sz;
+  }
+  uint64_t total_probes = 0;
+  _map_stats_table(map, map->table, map->table_sz, false, stats,
+                   &total_probes);
+  if (NULL != map->old_table) {
+    stats->bytes_used += (size_t)map->old_table_sz * map->entry_sz;
+    _map_stats_table(map, map->old_table, map->old_table_sz, true, stats,
+                     &total_probes);
+  }
+  if (map->num_entries > 0) {
+    stats->mean_probes = ((double)total_probes) / map->num_entries;
+  }
+}
+
+void _map_alloc_table(Map *map, uint32_t table_sz) {
+  map->table = map->alloc(map->entry_sz, table_sz, "_Entry");
+  map->table_sz = table_sz;
+  map->entries_thresh = calculate_thresh(table_sz);
+  map->entries_used = 0;
+}
+
+// Moves the entries in up to [num_slots] slots of the old table into the new
+// one, freeing the old table once all of them are moved.
+void _map_migrate(Map *map, uint32_t num_slots) {
+  if (NULL == map->old_table) {
+    return;
+  }
+  for (; num_slots > 0 && map->old_table_pos < map->old_table_sz;
+       --num_slots, ++map->old_table_pos) {
+    _Entry *me = entry_at(map, map->old_table, map->old_table_pos);
+    if (me->num_probes <= 0) {
+      continue;
+    }
+    _EntryBuffer carry;
+    _map_move(map, me, &carry.entry);
+    // Lookups in the old table continue past it.
+    me->num_probes = -1;
     bool too_many_inserts = false;
-    _map_insert_helper(map, me->pair.key, me->pair.value, me->hash_value,
-                       new_table, new_table_sz, &new_first, &new_last,
-                       &too_many_inserts);
+    _map_insert_helper(map, &carry.entry, false, &too_many_inserts);
     if (too_many_inserts) {
       FATALF("THIS SHOULD NEVER HAPPEN.");
     }
   }
+  if (map->old_table_pos == map->old_table_sz) {
+    map->dealloc((void **)&map->old_table);
+    map->old_table = NULL;
+  }
+}
 
-  map->dealloc((void **)&map->table);
-  map->table = new_table;
-  map->table_sz = new_table_sz;
-  map->first = new_first;
-  map->last = new_last;
-  map->entries_thresh = calculate_thresh(new_table_sz);
+// Replaces the table with an empty one of [new_table_sz], keeping the current
+// one as the old table until its entries are moved.
+void _map_start_resize(Map *map, uint32_t new_table_sz) {
+  ASSERT(NOT_NULL(map));
+  _map_migrate(map, UINT32_MAX);
+  map->old_table = map->table;
+  map->old_table_sz = map->table_sz;
+  map->old_table_pos = 0;
+  _map_alloc_table(map, new_table_sz);
+  map->resize_count++;
+}
+
+void _resize_table(Map *map, uint32_t new_table_sz) {
+  _map_start_resize(map, new_table_sz);
+  _map_migrate(map, UINT32_MAX);
+}
+
+void map_reserve(Map *map, uint32_t num_entries) {
+  ASSERT(NOT_NULL(map));
+  if (map->is_small) {
+    if (num_entries <= SMALL_MAP_SZ) {
+      return;
+    }
+    if (NULL != map->table) {
+      _small_spill(map, num_entries);
+      return;
+    }
+    map->is_small = false;
+  }
+  if (MAP_ENGINE_SWISS == map->engine) {
+    if (NULL == map->table) {
+      if (map->table_sz / 2 < num_entries) {
+        map->table_sz = num_entries * 2;
+      }
+      return;
+    }
+    uint32_t table_sz = _swiss_table_sz(num_entries);
+    if (table_sz > map->table_sz) {
+      _swiss_rehash(map, table_sz);
+    }
+    return;
+  }
+  uint32_t table_sz = table_sz_for(num_entries);
+  if (table_sz <= map->table_sz) {
+    return;
+  }
+  if (NULL == map->table) {
+    map->table_sz = table_sz;
+    map->entries_thresh = calculate_thresh(table_sz);
+    return;
+  }
+  _resize_table(map, table_sz);
+}
+
+void map_shrink_to_fit(Map *map) {
+  ASSERT(NOT_NULL(map));
+  if (NULL == map->table) {
+    return;
+  }
+  _map_migrate(map, UINT32_MAX);
+  if (0 == map->num_entries) {
+    // The table is allocated again by the next insertion.
+    map->dealloc((void **)&map->table);
+    if (NULL != map->ctrl) {
+      map->dealloc((void **)&map->ctrl);
+    }
+    map->table = NULL;
+    map->ctrl = NULL;
+    map->first = NULL;
+    map->last = NULL;
+    map->entries_used = 0;
+    map->table_sz = MIN_TABLE_SZ;
+    map->entries_thresh = calculate_thresh(MIN_TABLE_SZ);
+    return;
+  }
+  if (map->is_small) {
+    return;
+  }
+  // Also rehashes at the same size to clear removed entries.
+  if (MAP_ENGINE_SWISS == map->engine) {
+    uint32_t table_sz = _swiss_table_sz(map->num_entries);
+    if (table_sz < map->table_sz || map->entries_used > map->num_entries) {
+      _swiss_rehash(map, table_sz);
+    }
+    return;
+  }
+  uint32_t table_sz = table_sz_for(map->num_entries);
+  if (table_sz < map->table_sz || map->entries_used > map->num_entries) {
+    _resize_table(map, table_sz);
+  }
+}
+
+// Returns the first entry in [me, end) of an unordered map, or NULL.
+_Entry *_map_scan(const Map *map, _Entry *me, _Entry *end) {
+  for (; me < end; me = entry_at(map, me, 1)) {
+    if (me->num_probes > 0) {
+      return me;
+    }
+  }
+  return NULL;
+}
+
+// Returns the entry after [me] in an unordered map, or its first entry if [me]
+// is NULL. The old table is visited after the current one during a resize.
+_Entry *_map_next_occupied(const Map *map, _Entry *me) {
+  _Entry *end = entry_at(map, map->table, map->table_sz);
+  if (NULL == me || (me >= map->table && me < end)) {
+    _Entry *next =
+        _map_scan(map, NULL == me ? map->table : entry_at(map, me, 1), end);
+    if (NULL != next || NULL == map->old_table) {
+      return next;
+    }
+    me = map->old_table;
+  } else {
+    me = entry_at(map, me, 1);
+  }
+  return _map_scan(map, me,
+                   entry_at(map, map->old_table, map->old_table_sz));
 }
 
 void inc(M_iter *iter) {
   ASSERT(NOT_NULL(iter), NOT_NULL(iter->__entry));
-  iter->__entry = iter->__entry->next;
+  if (iter->__map->is_ordered) {
+    iter->__entry = links(iter->__map, iter->__entry)->next;
+  } else {
+    iter->__entry = _map_next_occupied(iter->__map, iter->__entry);
+  }
 }
 
 bool has(M_iter *iter) {
@@ -281,22 +1099,26 @@ bool has(M_iter *iter) {
 }
 
 Pair *pair(M_iter *iter) {
-  ASSERT(NOT_NULL(iter));
-  return (NULL == iter->__entry) ? NULL : &iter->__entry->pair;
+  ASSERT(NOT_NULL(iter), iter->__map->has_values);
+  return (NULL == iter->__entry) ? NULL : entry_pair(iter->__entry);
 }
 
 const void *key(M_iter *iter) {
   ASSERT(NOT_NULL(iter));
-  return (NULL == iter->__entry) ? NULL : iter->__entry->pair.key;
+  return (NULL == iter->__entry) ? NULL : iter->__entry->key;
 }
 
 void *value(M_iter *iter) {
   ASSERT(NOT_NULL(iter));
-  return (NULL == iter->__entry) ? NULL : iter->__entry->pair.value;
+  return (NULL == iter->__entry) ? NULL
+                                  : _entry_value(iter->__map, iter->__entry);
 }
 
 M_iter map_iter(Map *map) {
   ASSERT(NOT_NULL(map));
-  M_iter iter = {.__entry = map->first};
+  M_iter iter = {.__entry = map->first, .__map = map};
+  if (!map->is_ordered && NULL != map->table) {
+    iter.__entry = _map_next_occupied(map, NULL);
+  }
   return iter;
 }
\ No newline at end of file
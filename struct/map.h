@@ -7,6 +7,7 @@
 #define MAP_H_
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #include "util/util.h"
@@ -26,15 +27,78 @@ typedef struct {
   void *value;
 } Pair;
 
+// How a Map stores its entries. See map_use_engine().
+typedef enum {
+  // Robin Hood hashing with quadratic probing over prime-sized tables.
+  MAP_ENGINE_ROBIN_HOOD,
+  // Open addressing over a power-of-2 table with a separate array of 1-byte
+  // hash tags, which are probed 16 at a time.
+  MAP_ENGINE_SWISS,
+} MapEngine;
+
 typedef struct {
   Hasher hash;
   Comparator compare;
   Alloc alloc;
   Dealloc dealloc;
   uint32_t table_sz, num_entries, entries_thresh;
+  // Slots which are not empty, including those left by removed entries.
+  uint32_t entries_used;
   _Entry *table, *first, *last;
+  MapEngine engine;
+  // Only used by MAP_ENGINE_SWISS.
+  uint8_t *ctrl;
+  // Unordered maps do not link entries in insertion order, so their slots are
+  // smaller.
+  bool is_ordered;
+  // Key-only maps back Sets and store no values.
+  bool has_values;
+  uint32_t entry_sz;
+  // While a map which resizes incrementally is resizing, its entries are moved
+  // from [old_table] into [table] a few slots at a time, starting at
+  // [old_table_pos].
+  bool resizes_incrementally;
+  _Entry *old_table;
+  uint32_t old_table_sz, old_table_pos;
+  // Small maps keep their entries in the first [entries_used] slots of a flat
+  // table, which are scanned rather than hashed into, until they outgrow it.
+  bool is_small;
+  // Number of times the table was rebuilt. See MapStats.
+  uint32_t resize_count;
+#ifdef MAP_COUNT_LOOKUPS
+  uint64_t num_lookups, num_hits;
+#endif
 } Map;
 
+// Buckets in MapStats.probe_histogram.
+#define MAP_STATS_HISTOGRAM_SZ 8
+
+// A snapshot of how a map is using its table. See map_stats().
+typedef struct {
+  uint32_t num_entries;
+  uint32_t table_sz;
+  // Fraction of the slots which hold entries.
+  double load_factor;
+  // Slots left by removed entries which lookups still probe past.
+  uint32_t tombstones;
+  // Probes a lookup of each entry takes. For MAP_ENGINE_SWISS, this is the
+  // number of groups visited, and for a small map, the number of slots
+  // scanned.
+  double mean_probes;
+  uint32_t max_probes;
+  // probe_histogram[i] is the number of entries found by probe i + 1. The last
+  // bucket also counts every entry found after more probes.
+  uint32_t probe_histogram[MAP_STATS_HISTOGRAM_SZ];
+  // Times the table was rebuilt, including rehashes at the same size to clear
+  // removed entries.
+  uint32_t resize_count;
+  // Bytes held by the tables, not counting the Map itself.
+  size_t bytes_used;
+  // Lookups of [map] and how many of them found their key. Only counted when
+  // MAP_COUNT_LOOKUPS is defined, and 0 otherwise.
+  uint64_t lookups, hits, misses;
+} MapStats;
+
 // A function which processes a Pair ptr and has no return value.
 typedef void (*PairAction)(Pair *kv);
 
@@ -56,6 +120,77 @@ void map_init(Map *map, uint32_t size, Hasher, Comparator, Alloc, Dealloc);
 //   Map *map = map_create(51, my_hasher, my_comparator, my_alloc, my_dealloc);
 Map *map_create(uint32_t size, Hasher, Comparator, Alloc, Dealloc);
 
+// Sets the engine [map] uses to store its entries.
+//
+// Details:
+//   - Must be called before anything is inserted into [map].
+//   - Every engine has the same behavior, including iteration in insertion
+//     order. Only performance and memory use differ.
+//   - MAP_ENGINE_ROBIN_HOOD is the default.
+//   - MAP_ENGINE_SWISS compares only the entries whose 7-bit hash tag matches,
+//     so lookups, especially ones for missing keys, touch far less memory.
+//     It uses somewhat more memory for small maps.
+//
+// Usage:
+//   Map map;
+//   map_init(&map, 51, my_hasher, my_comparator, my_alloc, my_dealloc);
+//   map_use_engine(&map, MAP_ENGINE_SWISS);
+void map_use_engine(Map *map, MapEngine engine);
+
+// Makes [map] iterate over its entries in table order rather than insertion
+// order.
+//
+// Details:
+//   - Must be called before anything is inserted into [map].
+//   - Saves the two insertion-order links in every slot, which are 16 of the
+//     40 bytes each slot otherwise uses.
+//   - Iteration order is unspecified and changes whenever the table is
+//     resized.
+//
+// Usage:
+//   Map map;
+//   map_init(&map, 51, my_hasher, my_comparator, my_alloc, my_dealloc);
+//   map_use_unordered(&map);
+void map_use_unordered(Map *map);
+
+// Makes [map] spread the work of resizing across insertions instead of moving
+// every entry in the insertion which fills the table.
+//
+// Details:
+//   - Only supported by MAP_ENGINE_ROBIN_HOOD.
+//   - While resizing, the old and new tables are both kept. Each insertion
+//     moves the entries in a fixed number of slots of the old table, and
+//     lookups and removals check both tables.
+//   - Bounds the time of any one insertion at the cost of slower lookups for
+//     missing keys while a resize is in progress.
+//   - Entries can still be removed while iterating, but not inserted.
+//
+// Usage:
+//   Map map;
+//   map_init(&map, 51, my_hasher, my_comparator, my_alloc, my_dealloc);
+//   map_use_incremental_resize(&map);
+void map_use_incremental_resize(Map *map);
+
+// Makes [map] keep up to 8 entries in a flat table which is searched linearly,
+// and only use a hash table once it holds more.
+//
+// Details:
+//   - Must be called before anything is inserted into [map].
+//   - Suits the many maps which only ever hold a few entries, since the flat
+//     table is far smaller than a hash table sized for growth.
+//   - Works with either engine, which is used once [map] outgrows the flat
+//     table. It does not go back to being small.
+//
+// Usage:
+//   Map map;
+//   map_init(&map, 17, my_hasher, my_comparator, my_alloc, my_dealloc);
+//   map_use_small(&map);
+void map_use_small(Map *map);
+
+// Makes [map] store only keys, for use by Set. Lookups return the key instead
+// of a value, and pair() cannot be used on its iterators.
+void __map_use_key_only(Map *map);
+
 // Frees all internal memory for the Map.
 //
 // Details:
@@ -111,8 +246,38 @@ Pair map_remove(Map *, const void *key);
 //   void *val = map_lookup(map, some_key_ptr);
 void *map_lookup(const Map *map, const void *key);
 
+// Same as map_lookup(), but uses the precomputed [hval] and [comparator]
+// instead of the map's hasher and comparator.
+//
+// Details:
+//   - [hval] must equal what the map's hasher returns for the matching key.
+//   - [comparator] is called with [key] as its first argument and a stored key
+//     as its second, so [key] does not need to be of the same type as the
+//     stored keys.
+//
+// Usage:
+//   Map *map = ...;
+//   ...
+//   void *val = map_lookup_hashed(map, probe, probe_hash, probe_comparator);
+void *map_lookup_hashed(const Map *map, const void *key, uint32_t hval,
+                        Comparator comparator);
+
+// Looks up each of the [num_keys] [keys] in [map], storing the value for
+// keys[i] in values[i], or NULL if it is not present.
+//
+// Details:
+//   - Faster than calling map_lookup() for each key on tables larger than the
+//     cache, since the slots of many keys are fetched from memory at once.
+//
+// Usage:
+//   const void *keys[] = {key1, key2, key3};
+//   void *values[3];
+//   map_lookup_batch(map, keys, 3, values);
+void map_lookup_batch(const Map *map, const void *const keys[],
+                      uint32_t num_keys, void *values[]);
+
 // Iterates through each entry in [map], applying [pair_action] to each in
-// insertion order.
+// insertion order, or table order if it is unordered.
 //
 // Usage:
 //   Map *map = ...;
@@ -123,6 +288,33 @@ void *map_lookup(const Map *map, const void *key);
 //   map_iterate(map, each);
 void map_iterate(const Map *map, PairAction pair_action);
 
+// Resizes [map] if needed so that it can hold [num_entries] entries without
+// resizing again.
+//
+// Details:
+//   - Never shrinks [map].
+//   - Like insertion, may move entries, so it must not be called while
+//     iterating.
+//
+// Usage:
+//   Map map;
+//   map_init(&map, 51, my_hasher, my_comparator, my_alloc, my_dealloc);
+//   map_reserve(&map, num_items);
+//   for (i = 0; i < num_items; ++i) {
+//     map_insert(&map, items[i].key, items[i].value);
+//   }
+void map_reserve(Map *map, uint32_t num_entries);
+
+// Shrinks [map] to the smallest table which holds its entries, releasing the
+// memory of the old table.
+//
+// Details:
+//   - Also clears any space left by removed entries.
+//   - Frees the table entirely if [map] is empty. It is allocated again by the
+//     next insertion.
+//   - May move entries, so it must not be called while iterating.
+void map_shrink_to_fit(Map *map);
+
 // Returns the number of entries in [map].
 //
 // Details:
@@ -130,10 +322,26 @@ void map_iterate(const Map *map, PairAction pair_action);
 //     larger.
 uint32_t map_size(const Map *);
 
+// Fills [stats] with how [map] is using its table.
+//
+// Details:
+//   - Visits every slot, so it takes time proportional to the table size.
+//   - Define MAP_COUNT_LOOKUPS for the whole build to also count lookups,
+//     which adds to the size of every Map.
+//
+// Usage:
+//   MapStats stats;
+//   map_stats(map, &stats);
+//   if (stats.mean_probes > 2.0) {
+//     ...
+//   }
+void map_stats(const Map *map, MapStats *stats);
+
 // Struct for maintaining iterator state.
 typedef struct {
   // I know you won't listen, but don't manually manipulate this.
   _Entry *__entry;
+  const Map *__map;
 } M_iter;
 
 // Creates a new iterator for [map].
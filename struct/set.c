@@ -13,6 +13,9 @@
 #include "struct/map.h"
 #include "util/util.h"
 
+// Values looked up by each map_lookup_batch() call of set_contains_batch().
+#define CONTAINS_BATCH_SZ 64
+
 Set *set_create(uint32_t size, Hasher hasher, Comparator comparator,
                 Alloc alloc, Dealloc dealloc) {
   Set *set = (Set *)alloc(sizeof(Set), 1, "Set");
@@ -23,6 +26,27 @@ Set *set_create(uint32_t size, Hasher hasher, Comparator comparator,
 void set_init(Set *set, uint32_t size, Hasher hasher, Comparator comparator,
               Alloc alloc, Dealloc dealloc) {
   map_init(&set->map, size, hasher, comparator, alloc, dealloc);
+  __map_use_key_only(&set->map);
+}
+
+void set_use_engine(Set *set, MapEngine engine) {
+  ASSERT_NOT_NULL(set);
+  map_use_engine(&set->map, engine);
+}
+
+void set_use_unordered(Set *set) {
+  ASSERT_NOT_NULL(set);
+  map_use_unordered(&set->map);
+}
+
+void set_use_incremental_resize(Set *set) {
+  ASSERT_NOT_NULL(set);
+  map_use_incremental_resize(&set->map);
+}
+
+void set_use_small(Set *set) {
+  ASSERT_NOT_NULL(set);
+  map_use_small(&set->map);
 }
 
 void set_finalize(Set *set) {
@@ -52,8 +76,46 @@ void *set_lookup(const Set *set, const void *ptr) {
   return map_lookup(&set->map, ptr);
 }
 
+void *set_lookup_hashed(const Set *set, const void *ptr, uint32_t hval,
+                        Comparator comparator) {
+  ASSERT_NOT_NULL(set);
+  return map_lookup_hashed(&set->map, ptr, hval, comparator);
+}
+
+void set_contains_batch(const Set *set, const void *const values[],
+                        uint32_t num_values, bool contains[]) {
+  ASSERT(NOT_NULL(set), NOT_NULL(values), NOT_NULL(contains));
+  void *found[CONTAINS_BATCH_SZ];
+  uint32_t start;
+  for (start = 0; start < num_values; start += CONTAINS_BATCH_SZ) {
+    uint32_t batch_sz = (num_values - start < CONTAINS_BATCH_SZ)
+                            ? num_values - start
+                            : CONTAINS_BATCH_SZ;
+    map_lookup_batch(&set->map, values + start, batch_sz, found);
+    uint32_t i;
+    for (i = 0; i < batch_sz; ++i) {
+      contains[start + i] = NULL != found[i];
+    }
+  }
+}
+
+void set_reserve(Set *set, uint32_t num_entries) {
+  ASSERT_NOT_NULL(set);
+  map_reserve(&set->map, num_entries);
+}
+
+void set_shrink_to_fit(Set *set) {
+  ASSERT_NOT_NULL(set);
+  map_shrink_to_fit(&set->map);
+}
+
 int set_size(const Set *set) { return map_size(&set->map); }
 
+void set_stats(const Set *set, MapStats *stats) {
+  ASSERT_NOT_NULL(set);
+  map_stats(&set->map, stats);
+}
+
 void set_iterate(const Set *set, Action action) {
   ASSERT_NOT_NULL(set);
   M_iter iter;
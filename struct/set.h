@@ -40,6 +40,36 @@ void set_init(Set *set, uint32_t table_size, Hasher, Comparator, Alloc,
 //   Set *set = set_create(51, my_hasher, my_comparator, my_alloc, my_dealloc);
 Set *set_create(uint32_t table_size, Hasher, Comparator, Alloc, Dealloc);
 
+// Sets the engine [set] uses to store its values.
+//
+// Details:
+//   - Must be called before anything is inserted into [set].
+//   - See map_use_engine().
+//
+// Usage:
+//   Set set;
+//   set_init(&set, 51, my_hasher, my_comparator, my_alloc, my_dealloc);
+//   set_use_engine(&set, MAP_ENGINE_SWISS);
+void set_use_engine(Set *set, MapEngine engine);
+
+// Makes [set] iterate over its values in table order rather than insertion
+// order.
+//
+// Details:
+//   - Must be called before anything is inserted into [set].
+//   - See map_use_unordered().
+void set_use_unordered(Set *set);
+
+// Makes [set] spread the work of resizing across insertions.
+//
+// See map_use_incremental_resize().
+void set_use_incremental_resize(Set *set);
+
+// Makes [set] keep its first few values in a flat table.
+//
+// See map_use_small().
+void set_use_small(Set *set);
+
 // Frees all internal memory for the Set.
 //
 // Details:
@@ -94,8 +124,22 @@ bool set_remove(Set *set, const void *value);
 //   void *val = set_lookup(set, some_value_ptr);
 void *set_lookup(const Set *set, const void *value);
 
+// Same as set_lookup(), but uses the precomputed [hval] and [comparator]
+// instead of the set's hasher and comparator.
+//
+// See map_lookup_hashed().
+void *set_lookup_hashed(const Set *set, const void *value, uint32_t hval,
+                        Comparator comparator);
+
+// Sets contains[i] to whether values[i] is in [set] for each of the
+// [num_values] [values].
+//
+// See map_lookup_batch().
+void set_contains_batch(const Set *set, const void *const values[],
+                        uint32_t num_values, bool contains[]);
+
 // Iterates through each item in [set], applying [action] to each in
-// insertion order.
+// insertion order, or table order if it is unordered.
 //
 // Usage:
 //   Set *set = ...;
@@ -106,6 +150,17 @@ void *set_lookup(const Set *set, const void *value);
 //   set_iterate(set, each);
 void set_iterate(const Set *set, Action action);
 
+// Resizes [set] if needed so that it can hold [num_entries] values without
+// resizing again.
+//
+// See map_reserve().
+void set_reserve(Set *set, uint32_t num_entries);
+
+// Shrinks [set] to the smallest table which holds its values.
+//
+// See map_shrink_to_fit().
+void set_shrink_to_fit(Set *set);
+
 // Returns the number of entries in [set].
 //
 // Details:
@@ -113,6 +168,11 @@ void set_iterate(const Set *set, Action action);
 //     larger.
 int set_size(const Set *set);
 
+// Fills [stats] with how [set] is using its table.
+//
+// See map_stats().
+void set_stats(const Set *set, MapStats *stats);
+
 // Creates a new iterator for [map].
 //
 // Usage:
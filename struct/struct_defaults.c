@@ -23,7 +23,7 @@ Map *map_create_default() {
 
 void map_init_custom_comparator(Map *map, size_t size, Hasher hash,
                                 Comparator comp) {
-  map_init(map, DEFAULT_TABLE_SZ, hash, comp, __calloc_fn, __free_fn);
+  map_init(map, size, hash, comp, __calloc_fn, __free_fn);
 }
 
 Set *set_create_default() {
@@ -43,7 +43,7 @@ void set_init_sz(Set *set, size_t size) {
 
 void set_init_custom_comparator(Set *set, size_t size, Hasher hash,
                                 Comparator comp) {
-  set_init(set, DEFAULT_TABLE_SZ, hash, comp, __calloc_fn, __free_fn);
+  set_init(set, size, hash, comp, __calloc_fn, __free_fn);
 }
 
 #ifdef DEBUG_MEMORY
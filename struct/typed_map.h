@@ -0,0 +1,256 @@
+// typed_map.h
+//
+// Created on: Oct 18, 2026
+//     Author: Jeff Manzione
+//
+// Generates hash maps specialized to a key and a value type.
+//
+// Unlike Map, keys and values are stored in place rather than as pointers, and
+// the hash and equality functions are called directly so that the compiler can
+// inline them. Map remains the choice when the key type is not known until
+// runtime or keys are already pointers to larger objects.
+//
+// MAP_DEFINE(IdMap, uint32_t, Node *, id_hash, ID_EQ);
+// void fn() {
+//   IdMap map;
+//   IdMap_init(&map, 64);
+//   IdMap_insert(&map, 42, node);
+//   Node **found = IdMap_lookup(&map, 42);
+//   ...
+//   IdMap_finalize(&map);
+// }
+
+#ifndef STRUCT_TYPED_MAP_H_
+#define STRUCT_TYPED_MAP_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "alloc/alloc.h"
+#include "debug/debug.h"
+
+// Smallest table of a typed map. Tables are always a power of 2.
+#define TYPED_MAP_MIN_TABLE_SZ 8
+
+// Defines the type [name], a hash map from [key_type] to [value_type], and the
+// functions which operate on it.
+//
+// Details:
+//   - [hash_fn] is called as hash_fn(key) and returns a uint32_t. [eq_fn] is
+//     called as eq_fn(a, b) and returns nonzero if the keys are equal. Either
+//     may be a function or a function-like macro.
+//   - The functions are static inline, so this can go in a header or in the .c
+//     file which uses the map.
+//   - Tables are at most half full and are probed linearly. Removals shift
+//     later entries back instead of leaving markers, so lookups never slow
+//     down with churn.
+//   - Pointers returned by lookups and iteration are invalidated by the next
+//     insertion or removal.
+//
+// Defines, for MAP_DEFINE(IdMap, uint32_t, Node *, ...):
+//   // Creates an empty map with room for [size] entries before it grows.
+//   void IdMap_init(IdMap *map, uint32_t size);
+//   // Frees the table of [map], leaving it empty.
+//   void IdMap_finalize(IdMap *map);
+//   // Returns true if [key] was not already present. Otherwise, its value is
+//   // replaced.
+//   bool IdMap_insert(IdMap *map, uint32_t key, Node *value);
+//   // Returns a pointer to the value for [key], or NULL if it is not present.
+//   Node **IdMap_lookup(const IdMap *map, uint32_t key);
+//   // Returns true if [key] was present, storing its value in [value] unless
+//   // [value] is NULL.
+//   bool IdMap_remove(IdMap *map, uint32_t key, Node **value);
+//   uint32_t IdMap_size(const IdMap *map);
+//   // Returns the entry after [entry] in table order, or the first entry if
+//   // [entry] is NULL. Entries have [key] and [value] fields.
+//   IdMapEntry *IdMap_next(const IdMap *map, IdMapEntry *entry);
+//
+// Usage:
+//   #define ID_EQ(a, b) ((a) == (b))
+//   uint32_t id_hash(uint32_t id) { return id; }
+//   MAP_DEFINE(IdMap, uint32_t, Node *, id_hash, ID_EQ);
+//   ...
+//   IdMapEntry *entry;
+//   for (entry = IdMap_next(&map, NULL); NULL != entry;
+//        entry = IdMap_next(&map, entry)) {
+//     do_something(entry->key, entry->value);
+//   }
+#define MAP_DEFINE(name, key_type, value_type, hash_fn, eq_fn)                 \
+  typedef struct {                                                             \
+    /* 0 marks an empty slot. */                                               \
+    uint32_t hval;                                                             \
+    key_type key;                                                              \
+    value_type value;                                                          \
+  } name##Entry;                                                               \
+                                                                               \
+  typedef struct {                                                             \
+    name##Entry *table;                                                        \
+    uint32_t table_sz, num_entries;                                            \
+    /* Turns a hash into a slot by keeping the top bits of its product. */     \
+    uint32_t shift;                                                            \
+  } name;                                                                      \
+                                                                               \
+  static inline uint32_t name##_hash(key_type key) {                           \
+    uint32_t hval = hash_fn(key);                                              \
+    return 0 == hval ? 1 : hval;                                               \
+  }                                                                            \
+                                                                               \
+  static inline uint32_t name##_home(const name *map, uint32_t hval) {         \
+    return (uint32_t)(hval * 2654435769u) >> map->shift;                       \
+  }                                                                            \
+                                                                               \
+  static inline void name##_alloc(name *map, uint32_t table_sz) {              \
+    map->table = ALLOC_ARRAY(name##Entry, table_sz);                           \
+    map->table_sz = table_sz;                                                  \
+    map->shift = 32;                                                           \
+    for (; table_sz > 1; table_sz >>= 1) {                                     \
+      map->shift--;                                                            \
+    }                                                                          \
+  }                                                                            \
+                                                                               \
+  static inline void name##_init(name *map, uint32_t size) {                   \
+    ASSERT(NOT_NULL(map));                                                     \
+    map->table = NULL;                                                         \
+    map->num_entries = 0;                                                      \
+    map->table_sz = TYPED_MAP_MIN_TABLE_SZ;                                    \
+    while (map->table_sz / 2 < size) {                                         \
+      map->table_sz *= 2;                                                      \
+    }                                                                          \
+  }                                                                            \
+                                                                               \
+  static inline void name##_finalize(name *map) {                              \
+    ASSERT(NOT_NULL(map));                                                     \
+    if (NULL != map->table) {                                                  \
+      DEALLOC(map->table);                                                     \
+    }                                                                          \
+    map->table = NULL;                                                         \
+    map->num_entries = 0;                                                      \
+  }                                                                            \
+                                                                               \
+  static inline void name##_grow(name *map) {                                  \
+    name##Entry *old_table = map->table;                                       \
+    uint32_t old_table_sz = map->table_sz, i;                                  \
+    name##_alloc(map, 2 * old_table_sz);                                       \
+    uint32_t mask = map->table_sz - 1;                                         \
+    for (i = 0; i < old_table_sz; ++i) {                                       \
+      if (0 == old_table[i].hval) {                                            \
+        continue;                                                              \
+      }                                                                        \
+      uint32_t slot = name##_home(map, old_table[i].hval);                     \
+      while (0 != map->table[slot].hval) {                                     \
+        slot = (slot + 1) & mask;                                              \
+      }                                                                        \
+      map->table[slot] = old_table[i];                                         \
+    }                                                                          \
+    DEALLOC(old_table);                                                        \
+  }                                                                            \
+                                                                               \
+  static inline bool name##_insert(name *map, key_type key,                    \
+                                   value_type value) {                         \
+    ASSERT(NOT_NULL(map));                                                     \
+    if (NULL == map->table) {                                                  \
+      name##_alloc(map, map->table_sz);                                        \
+    }                                                                          \
+    uint32_t hval = name##_hash(key), mask = map->table_sz - 1;                \
+    uint32_t slot = name##_home(map, hval);                                    \
+    for (;; slot = (slot + 1) & mask) {                                        \
+      name##Entry *entry = &map->table[slot];                                  \
+      if (0 == entry->hval) {                                                  \
+        /* Only grows for a new key, then finds its slot in the new table. */  \
+        if (2 * (map->num_entries + 1) > map->table_sz) {                      \
+          name##_grow(map);                                                    \
+          mask = map->table_sz - 1;                                            \
+          slot = name##_home(map, hval);                                       \
+          while (0 != map->table[slot].hval) {                                 \
+            slot = (slot + 1) & mask;                                          \
+          }                                                                    \
+          entry = &map->table[slot];                                           \
+        }                                                                      \
+        entry->hval = hval;                                                    \
+        entry->key = key;                                                      \
+        entry->value = value;                                                  \
+        map->num_entries++;                                                    \
+        return true;                                                           \
+      }                                                                        \
+      if (hval == entry->hval && eq_fn(entry->key, key)) {                     \
+        entry->value = value;                                                  \
+        return false;                                                          \
+      }                                                                        \
+    }                                                                          \
+  }                                                                            \
+                                                                               \
+  /* Returns the slot holding [key], or UINT32_MAX. */                         \
+  static inline uint32_t name##_find(const name *map, key_type key) {          \
+    if (NULL == map->table) {                                                  \
+      return UINT32_MAX;                                                       \
+    }                                                                          \
+    uint32_t hval = name##_hash(key), mask = map->table_sz - 1;                \
+    uint32_t slot = name##_home(map, hval);                                    \
+    for (;; slot = (slot + 1) & mask) {                                        \
+      const name##Entry *entry = &map->table[slot];                            \
+      if (0 == entry->hval) {                                                  \
+        return UINT32_MAX;                                                     \
+      }                                                                        \
+      if (hval == entry->hval && eq_fn(entry->key, key)) {                     \
+        return slot;                                                           \
+      }                                                                        \
+    }                                                                          \
+  }                                                                            \
+                                                                               \
+  static inline value_type *name##_lookup(const name *map, key_type key) {     \
+    ASSERT(NOT_NULL(map));                                                     \
+    uint32_t slot = name##_find(map, key);                                     \
+    return UINT32_MAX == slot ? NULL : &map->table[slot].value;                \
+  }                                                                            \
+                                                                               \
+  static inline bool name##_remove(name *map, key_type key,                    \
+                                   value_type *value) {                        \
+    ASSERT(NOT_NULL(map));                                                     \
+    uint32_t hole = name##_find(map, key);                                     \
+    if (UINT32_MAX == hole) {                                                  \
+      return false;                                                            \
+    }                                                                          \
+    if (NULL != value) {                                                       \
+      *value = map->table[hole].value;                                         \
+    }                                                                          \
+    /* Moves back each later entry in the run which may fill the hole. */      \
+    uint32_t mask = map->table_sz - 1, slot = hole;                            \
+    while (true) {                                                             \
+      slot = (slot + 1) & mask;                                                \
+      if (0 == map->table[slot].hval) {                                        \
+        break;                                                                 \
+      }                                                                        \
+      uint32_t home = name##_home(map, map->table[slot].hval);                 \
+      if (((slot - home) & mask) >= ((slot - hole) & mask)) {                  \
+        map->table[hole] = map->table[slot];                                   \
+        hole = slot;                                                           \
+      }                                                                        \
+    }                                                                          \
+    map->table[hole].hval = 0;                                                 \
+    map->num_entries--;                                                        \
+    return true;                                                               \
+  }                                                                            \
+                                                                               \
+  static inline uint32_t name##_size(const name *map) {                        \
+    ASSERT(NOT_NULL(map));                                                     \
+    return map->num_entries;                                                   \
+  }                                                                            \
+                                                                               \
+  static inline name##Entry *name##_next(const name *map,                      \
+                                         name##Entry *entry) {                 \
+    ASSERT(NOT_NULL(map));                                                     \
+    if (NULL == map->table) {                                                  \
+      return NULL;                                                             \
+    }                                                                          \
+    name##Entry *end = map->table + map->table_sz;                             \
+    for (entry = (NULL == entry) ? map->table : entry + 1; entry < end;        \
+         ++entry) {                                                            \
+      if (0 != entry->hval) {                                                  \
+        return entry;                                                          \
+      }                                                                        \
+    }                                                                          \
+    return NULL;                                                               \
+  }
+
+#endif /* STRUCT_TYPED_MAP_H_ */
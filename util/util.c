@@ -18,10 +18,34 @@
   (((x & 0x000000FF) == 0) || ((x & 0x0000FF00) == 0) || \
    ((x & 0x00FF0000) == 0) || ((x & 0xFF000000) == 0))
 
-uint32_t default_hasher(const void *ptr) { return (uint32_t)(intptr_t)ptr; }
+// The 64-bit finalizer of MurmurHash3.
+uint32_t hash_uint64(uint64_t value) {
+  value ^= value >> 33;
+  value *= 0xFF51AFD7ED558CCDULL;
+  value ^= value >> 33;
+  value *= 0xC4CEB9FE1A85EC53ULL;
+  value ^= value >> 33;
+  return (uint32_t)value;
+}
+
+// The 32-bit finalizer of MurmurHash3.
+uint32_t hash_uint32(uint32_t value) {
+  value ^= value >> 16;
+  value *= 0x85EBCA6B;
+  value ^= value >> 13;
+  value *= 0xC2B2AE35;
+  value ^= value >> 16;
+  return value;
+}
+
+uint32_t default_hasher(const void *ptr) {
+  return hash_uint64((uint64_t)(uintptr_t)ptr);
+}
 
 int32_t default_comparator(const void *ptr1, const void *ptr2) {
-  return ((intptr_t)ptr1) - ((intptr_t)ptr2);
+  // The difference of two pointers does not fit in an int32_t.
+  return ((uintptr_t)ptr1 > (uintptr_t)ptr2) -
+         ((uintptr_t)ptr1 < (uintptr_t)ptr2);
 }
 
 uint32_t string_hasher(const void *ptr) {
@@ -35,11 +59,12 @@ uint32_t string_hasher(const void *ptr) {
 }
 
 uint32_t string_hasher_len(const char *ptr, size_t len) {
-  int i;
+  unsigned char *s = (unsigned char *)ptr;
+  size_t i;
   uint32_t hval = FNV_1A_32_OFFSET;
   for (i = 0; i < len; ++i) {
     hval *= FNV_32_PRIME;
-    hval ^= (uint32_t)ptr[i];
+    hval ^= (uint32_t)s[i];
   }
   return hval;
 }
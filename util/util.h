@@ -23,22 +23,37 @@ typedef uint32_t (*Hasher)(const void *);
 // The magnitude of the return value does not necessarily provide any signal.
 typedef int32_t (*Comparator)(const void *ptr1, const void *ptr2);
 
-// Convets the ptr into an unsigned integer. The value is generally equivent to
-// the input pointer, but not guaranteed.
+// Mixes all 64 bits of [value] into a 32-bit hash.
+//
+// Details:
+//   - Values which differ in any bit, including only in their high 32 bits,
+//     get unrelated hashes.
+uint32_t hash_uint64(uint64_t value);
+
+// Spreads the bits of a 32-bit hash so that any subset of its bits, high or
+// low, can pick a slot.
+uint32_t hash_uint32(uint32_t value);
+
+// Hashes the address of [ptr], not what it points to.
+//
+// Details:
+//   - Mixes the whole address, so the zero low bits of aligned pointers and
+//     the shared high bits of nearby ones do not cluster keys in a table.
 //
 // This should only be used when hashing ptrs in a context where inputs are
 // unique.
 uint32_t default_hasher(const void *ptr);
 
-// Compares based on pointer math. Roughly equivalent to [ptr1 - ptr2].
+// Orders pointers by address, returning -1, 0 or 1.
 //
-// This should only be used when comparing ptrs in acontest where inputs are
+// This should only be used when comparing ptrs in a context where inputs are
 // unique.
 int32_t default_comparator(const void *ptr1, const void *ptr2);
 
 // Does hashing and comparing based on string content.
 uint32_t string_hasher(const void *ptr);
 int32_t string_comparator(const void *ptr1, const void *ptr2);
+// Same as string_hasher() for the first [len] characters of [ptr].
 uint32_t string_hasher_len(const char *ptr, size_t len);
 
 #endif /* SHARED_H_ */